@@ -0,0 +1,53 @@
+#!/bin/sh
+# Lists the op pairs and triples that are run most often by the benchmarks in this directory.
+#
+# usage: bench/op-profile.sh <build-dir> [count]
+#
+# The build must be configured with -DBUG_OP_PROFILE=ON (see "Op profile" in src/bug.c) and, like
+# bench/run.sh, be directly inside the repository. The profiles of all benchmarks are added together
+# and the top [count] (default 20) sequences of each length are printed with their share of all the
+# pairs (or triples) that were run. Superinstructions (see fuse_superinstructions in src/bug.c) are chosen from this.
+
+bench_dir=$(cd "$(dirname "$0")" && pwd)
+build_dir=$1
+count=${2:-20}
+
+if [ ! -x "$build_dir/bug" ]; then
+  echo "usage: $0 <build-dir> [count]"
+  exit 1
+fi
+
+profiles=$(mktemp -d) || exit 1
+trap 'rm -rf "$profiles"' EXIT
+
+cd "$build_dir" || exit 1
+for bench in "$bench_dir"/*.bug; do
+  BUG_OP_PROFILE="$profiles/$(basename "$bench" .bug).txt" ./bug < "$bench" | head -n 1 > /dev/null
+done
+
+# op names are read from the ops enum (an op's code is its position in it)
+sed -n 's/^ *op_\([a-z0-9_]*\).*/\1/p' "$bench_dir/../src/ops.h" > "$profiles/ops"
+
+cat "$profiles"/*.txt | awk -v ops="$profiles/ops" '
+  BEGIN { n = 0; while ((getline name < ops) > 0) names[n++] = name }
+  {
+    key = $1
+    for (k = 3; k <= NF; ++k) key = key " " names[$k]
+    counts[key] += $2
+    totals[$1] += $2
+  }
+  END {
+    for (key in counts) {
+      split(key, parts, " ")
+      printf "%d %.0f %.2f%% %s\n", parts[1], counts[key], 100 * counts[key] / totals[parts[1]], substr(key, 3)
+    }
+  }
+' | sort -k1,1n -k2,2nr | awk -v count="$count" '
+  $1 != size { size = $1; shown = 0; print (NR > 1 ? "\n" : "") ($1 == 2 ? "pairs" : "triples") }
+  shown < count {
+    ops = $4
+    for (k = 5; k <= NF; ++k) ops = ops " " $k
+    printf "%12s %7s  %s\n", $2, $3, ops
+    ++shown
+  }
+'
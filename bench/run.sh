@@ -0,0 +1,35 @@
+#!/bin/sh
+# Times each benchmark in this directory against a build of bug.
+#
+# usage: bench/run.sh <build-dir> [runs]
+#
+# The build directory must be directly inside the repository (bug loads ../bootstrap and ../lib).
+# Each benchmark is a single expression that is fed to the REPL. The REPL doesn't exit at the
+# end of its input, so a run is stopped as soon as the first result has been printed.
+# Prints the best wall clock time (in milliseconds) of all runs.
+
+bench_dir=$(cd "$(dirname "$0")" && pwd)
+build_dir=$1
+runs=${2:-5}
+
+if [ ! -x "$build_dir/bug" ]; then
+  echo "usage: $0 <build-dir> [runs]"
+  exit 1
+fi
+
+cd "$build_dir" || exit 1
+for bench in "$bench_dir"/*.bug; do
+  best=
+  run=0
+  while [ $run -lt $runs ]; do
+    start=$(date +%s%N)
+    ./bug < "$bench" | head -n 1 > /dev/null
+    end=$(date +%s%N)
+    ms=$(( (end - start) / 1000000 ))
+    if [ -z "$best" ] || [ $ms -lt $best ]; then
+      best=$ms
+    fi
+    run=$((run + 1))
+  done
+  echo "$(basename "$bench" .bug): ${best}ms"
+done
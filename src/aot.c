@@ -0,0 +1,216 @@
+#include "aot.h"
+
+/* AOT
+ * When bug is built with the BUG_AOT cmake option, `bug --aot <bc file> <c file>` compiles every function
+ * in a bytecode file (see read_bytecode_file) to C, and the build compiles bootstrap/compiler.bc that way
+ * into a library (compiler-aot). When bug starts, it loads the library (if it is there) and gives each
+ * function it read from compiler.bc the C code that was compiled from it -- so the simple ops of the bootstrap
+ * compiler (and of compiling core with it) run as C. It still goes back to run for every call and return.
+ *
+ * The generated C for a function works like the JIT's machine code (see "JIT" in jit.c): it has a label for
+ * each instruction, and does simple ops inline against the runtime API in bug.h (see the AOT_ macros in
+ * aot.h). Calls, returns and every other op exit back to run, which runs that instruction itself and goes
+ * back into the C code when the function is restarted or jumps backward. So everything else (frames,
+ * call caches, errors) is still handled by run.
+ *
+ * The library's functions are matched up with the functions that were read in the order aot_functions
+ * finds them, and a function only gets C code that was compiled from exactly the same bytecode -- so a
+ * library that is older than compiler.bc is harmless (the functions that changed are just interpreted).
+ * Functions whose code is replaced (see builtin_function_code) lose their C code.
+ */
+
+void aot_collect_functions(struct object *f, struct object *functions) {
+  struct object *constants, *constant;
+  ufixnum_t i;
+  dynamic_array_push(functions, f);
+  constants = FUNCTION_CONSTANTS(f);
+  for (i = 0; i < DYNAMIC_ARRAY_LENGTH(constants); ++i) {
+    constant = DYNAMIC_ARRAY_VALUES(constants)[i];
+    if (type_of(constant) == gis->function_type && !FUNCTION_IS_BUILTIN(constant))
+      aot_collect_functions(constant, functions);
+  }
+}
+
+/* all bytecode functions in bc (the function read from a bytecode file), and in the constants of those */
+struct object *aot_functions(struct object *bc) {
+  struct object *functions;
+  functions = dynamic_array(64);
+  aot_collect_functions(bc, functions);
+  return functions;
+}
+
+/* writes the C for the instruction at i (its label is written by aot_write_function) */
+void aot_write_instruction(FILE *out, ufixnum_t i, uint32_t word) {
+  unsigned char op;
+  ufixnum_t arg;
+  op = checked_op_of(bytecode_op_of(INSTRUCTION_OP(word)));
+  arg = INSTRUCTION_ARG(word);
+  switch (op) {
+    case op_load_from_stack_0:
+    case op_load_from_stack_1:
+      arg = op - op_load_from_stack_0;
+    case op_load_from_stack:
+      fprintf(out, "*sp++ = locals[%lu];", (unsigned long)arg);
+      break;
+    case op_store_to_stack_0:
+    case op_store_to_stack_1:
+      arg = op - op_store_to_stack_0;
+    case op_store_to_stack:
+      fprintf(out, "locals[%lu] = *--sp;", (unsigned long)arg);
+      break;
+    case op_const_0:
+    case op_const_1:
+    case op_const_2:
+    case op_const_3:
+      arg = op - op_const_0;
+    case op_const:
+      fprintf(out, "*sp++ = constants[%lu];", (unsigned long)arg);
+      break;
+    case op_load_nil:
+      fprintf(out, "*sp++ = NIL;");
+      break;
+    case op_drop:
+      fprintf(out, "--sp;");
+      break;
+    case op_dup:
+      fprintf(out, "sp[0] = sp[-1]; ++sp;");
+      break;
+    case op_push_arg:
+    case op_push_args:
+      break;
+    case op_jump_forward:
+    case op_jump_backward:
+      fprintf(out, "goto i%lu;", (unsigned long)arg);
+      break;
+    case op_jump_forward_when_nil:
+      fprintf(out, "if (*--sp == NIL) goto i%lu;", (unsigned long)arg);
+      break;
+    case op_add:
+    case op_sub:
+    case op_mul:
+      fprintf(out, "AOT_FIXNUM_ARITHMETIC(%lu, %s);", (unsigned long)i,
+              op == op_add ? "+" : op == op_sub ? "-" : "*");
+      break;
+    case op_addi:
+    case op_subi:
+      fprintf(out, "AOT_FIXNUM_IMMEDIATE(%lu, %s, %lu);", (unsigned long)i, op == op_addi ? "+" : "-",
+              (unsigned long)arg);
+      break;
+    case op_lt:
+    case op_gt:
+    case op_lte:
+    case op_gte:
+      fprintf(out, "AOT_FIXNUM_COMPARE(%lu, %s);", (unsigned long)i,
+              op == op_lt ? "<" : op == op_gt ? ">" : op == op_lte ? "<=" : ">=");
+      break;
+    case op_and:
+      fprintf(out, "AOT_BINARY(sp[-2] != NIL && sp[-1] != NIL ? sp[-1] : NIL);");
+      break;
+    case op_or:
+      fprintf(out, "AOT_BINARY(sp[-1] != NIL ? sp[-1] : sp[-2]);");
+      break;
+    case op_eq:
+      fprintf(out, "AOT_BINARY(equals(sp[-2], sp[-1]) ? T : NIL);");
+      break;
+    case op_car:
+      fprintf(out, "AOT_CONS_PART(%lu, CONS_CAR);", (unsigned long)i);
+      break;
+    case op_cdr:
+      fprintf(out, "AOT_CONS_PART(%lu, CONS_CDR);", (unsigned long)i);
+      break;
+    case op_cons:
+      fprintf(out, "AOT_BINARY(cons(sp[-2], sp[-1]));");
+      break;
+    case op_symbol_value:
+      fprintf(out, "sp[-1] = symbol_get_value(sp[-1]);");
+      break;
+    case op_struct_field:
+      fprintf(out, "AOT_BINARY(struct_field(sp[-2], sp[-1]));");
+      break;
+    case op_dynamic_array_get:
+      fprintf(out, "AOT_BINARY(dynamic_array_get(sp[-2], sp[-1]));");
+      break;
+    default: /* run does everything else */
+      fprintf(out, "AOT_EXIT(%lu);", (unsigned long)i);
+      break;
+  }
+}
+
+/* writes the bytecode of the kth function and the C function that runs it */
+void aot_write_function(FILE *out, ufixnum_t k, struct object *f) {
+  struct object *code;
+  ufixnum_t i, n;
+  code = FUNCTION_CODE(f);
+  fprintf(out, "\nstatic unsigned char code_%lu[] = {", (unsigned long)k);
+  for (i = 0; i < DYNAMIC_BYTE_ARRAY_LENGTH(code); ++i)
+    fprintf(out, "%s%u,", i % 24 == 0 ? "\n  " : "", (unsigned char)DYNAMIC_BYTE_ARRAY_BYTES(code)[i]);
+  fprintf(out, "\n  0 /* (so the array is never empty) */\n};\n\n");
+
+  if (FUNCTION_INSTRUCTIONS(f) == NULL) decode_function(f);
+  n = FUNCTION_INSTRUCTION_COUNT(f);
+  fprintf(out, "static ufixnum_t run_%lu(struct native_state *state, ufixnum_t i) {\n", (unsigned long)k);
+  fprintf(out, "  struct object **sp = state->sp;\n");
+  fprintf(out, "  struct object **locals = state->locals, **constants = state->constants;\n");
+  fprintf(out, "  (void)locals; (void)constants;\n");
+  fprintf(out, "  switch (i) {\n");
+  for (i = 0; i <= n; ++i) fprintf(out, "    case %lu: goto i%lu;\n", (unsigned long)i, (unsigned long)i);
+  fprintf(out, "    default: AOT_EXIT(i);\n  }\n");
+  for (i = 0; i < n; ++i) {
+    fprintf(out, "i%lu: ", (unsigned long)i);
+    aot_write_instruction(out, i, decoded_instruction(f, i));
+    fprintf(out, "\n");
+  }
+  fprintf(out, "i%lu: AOT_EXIT(%lu); /* the end -- run finishes the function */\n}\n", (unsigned long)n,
+          (unsigned long)n);
+}
+
+/* compiles every function in bc (read from the file at bc_path) to C, and writes it to the file at path */
+void aot_write_c(struct object *bc, char *bc_path, char *path) {
+  struct object *functions, *code;
+  ufixnum_t k, n;
+  FILE *out;
+  out = fopen(path, "w");
+  if (out == NULL) {
+    printf("Failed to open %s to write AOT code to.\n", path);
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  functions = aot_functions(bc);
+  n = DYNAMIC_ARRAY_LENGTH(functions);
+  fprintf(out, "/* Generated by bug --aot from %s -- don't edit (see \"AOT\" in src/aot.c) */\n", bc_path);
+  fprintf(out, "#include \"aot.h\"\n");
+  for (k = 0; k < n; ++k) aot_write_function(out, k, DYNAMIC_ARRAY_VALUES(functions)[k]);
+
+  fprintf(out, "\nstatic struct aot_function functions[] = {\n");
+  for (k = 0; k < n; ++k) {
+    code = FUNCTION_CODE(DYNAMIC_ARRAY_VALUES(functions)[k]);
+    fprintf(out, "  {%lu, code_%lu, run_%lu},\n", (unsigned long)DYNAMIC_BYTE_ARRAY_LENGTH(code), (unsigned long)k,
+            (unsigned long)k);
+  }
+  fprintf(out, "  {0, NULL, NULL} /* (so the array is never empty) */\n};\n\n");
+  fprintf(out, "AOT_EXPORT struct aot_function *aot_table(ufixnum_t *count) {\n");
+  fprintf(out, "  *count = %lu;\n  return functions;\n}\n", (unsigned long)n);
+  fclose(out);
+}
+
+/* gives the functions in bc the C code in the AOT library at path -- does nothing if there is no library */
+void aot_load(struct object *bc, char *path) {
+  HINSTANCE library;
+  aot_table_fn table;
+  struct aot_function *compiled;
+  struct object *functions, *f;
+  ufixnum_t k, count;
+
+  library = LoadLibrary(path);
+  if (library == NULL) return;
+  table = (aot_table_fn)GetProcAddress(library, "aot_table");
+  if (table == NULL) return;
+  compiled = table(&count);
+
+  functions = aot_functions(bc);
+  for (k = 0; k < count && k < DYNAMIC_ARRAY_LENGTH(functions); ++k) {
+    f = DYNAMIC_ARRAY_VALUES(functions)[k];
+    if (compiled[k].code_length == DYNAMIC_BYTE_ARRAY_LENGTH(FUNCTION_CODE(f)) &&
+        memcmp(compiled[k].code, DYNAMIC_BYTE_ARRAY_BYTES(FUNCTION_CODE(f)), compiled[k].code_length) == 0)
+      FUNCTION_AOT(f) = &compiled[k];
+  }
+}
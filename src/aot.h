@@ -0,0 +1,59 @@
+#ifndef _AOT_H
+#define _AOT_H
+
+#include "bug.h"
+
+/* a function compiled ahead of time to C (see aot.c) */
+struct aot_function {
+  ufixnum_t code_length; /* the bytecode it was compiled from -- it is only used for functions with the same code */
+  unsigned char *code;
+  ufixnum_t (*run)(struct native_state *state, ufixnum_t i); /* runs it from instruction i, and returns the instruction it stopped at */
+};
+
+/* the one thing an AOT library exports (as aot_table) -- its functions in the order aot_functions finds them */
+typedef struct aot_function *(*aot_table_fn)(ufixnum_t *count);
+
+#ifdef _WIN32
+#define AOT_EXPORT __declspec(dllexport)
+#else
+#define AOT_EXPORT
+#endif
+
+/* Used by the generated code
+ * (sp, locals and constants are the generated function's copies of the native_state -- run has already
+ * made room for everything the function pushes, see "Verifier" in bug.c) */
+#define AOT_EXIT(i)     \
+  {                     \
+    state->sp = sp;     \
+    return i;           \
+  }
+/* replaces the top two values with x */
+#define AOT_BINARY(x) \
+  sp[-2] = (x);       \
+  --sp
+/* exits to run at instruction i unless the top two values are immediate fixnums */
+#define AOT_FIXNUMS(i) \
+  if (!IS_IMMEDIATE_FIXNUM(sp[-2]) || !IS_IMMEDIATE_FIXNUM(sp[-1])) AOT_EXIT(i)
+#define AOT_FIXNUM_ARITHMETIC(i, op) \
+  AOT_FIXNUMS(i);                    \
+  AOT_BINARY(fixnum(IMMEDIATE_FIXNUM_VALUE(sp[-2]) op IMMEDIATE_FIXNUM_VALUE(sp[-1])))
+/* x op n (for addi and subi) -- exits to run at instruction i unless x is an immediate fixnum */
+#define AOT_FIXNUM_IMMEDIATE(i, op, n)          \
+  if (!IS_IMMEDIATE_FIXNUM(sp[-1])) AOT_EXIT(i); \
+  sp[-1] = fixnum(IMMEDIATE_FIXNUM_VALUE(sp[-1]) op (fixnum_t)(n))
+/* tagging keeps the order of immediate fixnums */
+#define AOT_FIXNUM_COMPARE(i, op) \
+  AOT_FIXNUMS(i);                 \
+  AOT_BINARY((intptr_t)sp[-2] op (intptr_t)sp[-1] ? T : NIL)
+/* car/cdr of nil is nil, and of a cons is part -- anything else exits to run at instruction i */
+#define AOT_CONS_PART(i, part)                          \
+  if (sp[-1] != NIL) {                                  \
+    if (type_of(sp[-1]) != gis->cons_type) AOT_EXIT(i); \
+    sp[-1] = part(sp[-1]);                              \
+  }
+
+struct object *aot_functions(struct object *bc);
+void aot_write_c(struct object *bc, char *bc_path, char *path);
+void aot_load(struct object *bc, char *path);
+
+#endif
@@ -27,12 +27,15 @@ char *type_name_cstr(struct object *o) {
   return STRING_CONTENTS(name);
 }
 
+/* immediate fixnums have no w0 to read the type from -- check IS_IMMEDIATE_FIXNUM first */
 #define HAS_OBJECT_TYPE(o) (OBJECT_TYPE(o) & 2)
 #define TYPE_INDEX(o) (OBJECT_TYPE(o) >> 2)
 #define IS_TYPE_USER_DEFINED(o) (HAS_OBJECT_TYPE(o) && OBJECT_TYPE(o) > HIGHEST_TYPE)
+#define IS_FLONUM(o) (!IS_IMMEDIATE_FIXNUM(o) && HAS_OBJECT_TYPE(o) && OBJECT_TYPE(o) == type_flonum)
 
 /* returns object of type type. */
 struct object *type_of(struct object *o) {
+  if (IS_IMMEDIATE_FIXNUM(o)) return gis->fixnum_type;
   if (o == NIL) return gis->symbol_type;
   if (HAS_OBJECT_TYPE(o)) {
     /* cannot use validation here, because validation calls type_of and infinitely recurses */
@@ -50,6 +53,7 @@ char *type_name_of_cstr(struct object *o) {
 }
 
 enum object_type object_type_of(struct object *o) {
+  if (IS_IMMEDIATE_FIXNUM(o)) return type_fixnum;
   if (HAS_OBJECT_TYPE(o)) {
     /* cannot use validation here, because validation calls type_of and infinitely recurses */
     return OBJECT_TYPE(o);
@@ -109,7 +113,9 @@ struct object *object(enum object_type t) {
 }
 
 struct object *fixnum(fixnum_t fixnum) {
-  struct object *o = object(type_fixnum);
+  struct object *o;
+  if (CAN_BE_IMMEDIATE_FIXNUM(fixnum)) return IMMEDIATE_FIXNUM(fixnum);
+  o = object(type_fixnum);
   NC(o, "Failed to allocate fixnum object.");
   o->w1.value.fixnum = fixnum;
   return o;
@@ -254,6 +260,7 @@ struct object *dynamic_byte_array(ufixnum_t initial_capacity) {
   DYNAMIC_BYTE_ARRAY_BYTES(o) = malloc(DYNAMIC_BYTE_ARRAY_CAPACITY(o) * sizeof(char));
   NC(DYNAMIC_BYTE_ARRAY_BYTES(o), "Failed to allocate dynamic-byte-array bytes.");
   DYNAMIC_BYTE_ARRAY_LENGTH(o) = 0;
+  DYNAMIC_BYTE_ARRAY_VERSION(o) = 0;
   return o;
 }
 
@@ -463,6 +470,7 @@ struct object *alloc_struct(struct object *type, char init_defaults) {
 void set_struct_field(struct object *instance, struct object *sdes, struct object *value) {
   struct object *type, *field_type;
   ufixnum_t i;
+  int int_value;
 
   type = type_of(instance);
 
@@ -488,7 +496,8 @@ void set_struct_field(struct object *instance, struct object *sdes, struct objec
   * TODO: handle different types here:
   */
  if (field_type == gis->fixnum_type || field_type == gis->int_type) {
-  memcpy(&((char *)OBJECT_POINTER(instance))[TYPE_STRUCT_OFFSETS(type)[i]], &FIXNUM_VALUE(value), sizeof(int));
+  int_value = FIXNUM_VALUE(value);
+  memcpy(&((char *)OBJECT_POINTER(instance))[TYPE_STRUCT_OFFSETS(type)[i]], &int_value, sizeof(int));
  } else if (field_type == gis->object_type) {
   memcpy(&((char *)OBJECT_POINTER(instance))[TYPE_STRUCT_OFFSETS(type)[i]], &value, sizeof(struct object *));
  } else {
@@ -510,11 +519,194 @@ struct object *function(struct object *constants, struct object *code, ufixnum_t
   FUNCTION_DOCSTRING(o) = NIL;
   FUNCTION_NARGS(o) = 0;
   FUNCTION_IS_BUILTIN(o) = 0;
+  FUNCTION_BUILTIN_INDEX(o) = 0;
   FUNCTION_IS_MACRO(o) = 0;
-  FUNCTION_ACCEPTS_ALL(o) = 0;
+  FUNCTION_NOPTIONAL(o) = 0;
+  FUNCTION_REST(o) = rest_none;
+  FUNCTION_INSTRUCTIONS(o) = NULL;
+  FUNCTION_INSTRUCTION_COUNT(o) = 0;
+  FUNCTION_CODE_VERSION(o) = 0;
+  FUNCTION_SHARES_INSTRUCTIONS(o) = 0;
+  FUNCTION_CALL_CACHES(o) = NULL;
+  FUNCTION_MAX_DEPTH(o) = 0;
+  FUNCTION_CLOSURE(o) = NIL;
+#ifdef JIT
+  FUNCTION_HEAT(o) = 0;
+  FUNCTION_JIT(o) = NULL;
+#endif
+#ifdef AOT
+  FUNCTION_AOT(o) = NULL;
+#endif
+#ifdef REGISTERS
+  FUNCTION_REGISTER_BLOCKS(o) = NULL;
+  FUNCTION_REGISTER_BLOCK_COUNT(o) = 0;
+#endif
+  return o;
+}
+
+/* Closures
+ * A function that uses the locals of the function it is made in is compiled to a template (a constant of
+ * that function) whose code loads those values with load-closure. make-closure copies the template with
+ * the values it captured -- each closure shares its template's code, constants and decoded instructions
+ * (the template is decoded first), and has its own array of values. A local that is set after it is
+ * captured (or by the closure) is kept in a box (a cons whose car is its value -- see store-box) so the
+ * function and its closures share it. The compiler works all of that out (see compile-let in
+ * lib/compiler/compile.bug).
+ */
+
+/* a copy of the template f that load-closure gets the count values from */
+struct object *make_closure(struct object *f, struct object **values, ufixnum_t count) {
+  struct object *o;
+  ufixnum_t i;
+  if (FUNCTION_INSTRUCTIONS(f) == NULL) decode_function(f);
+  FUNCTION_SHARES_INSTRUCTIONS(f) = 1; /* (so redecode_function doesn't free them) */
+  o = object(type_function);
+  NC(o, "Failed to allocate closure object.");
+  o->w1.value.function = malloc(sizeof(struct function));
+  NC(o->w1.value.function, "Failed to allocate closure.");
+  *o->w1.value.function = *f->w1.value.function;
+  FUNCTION_CLOSURE(o) = dynamic_array(count > 0 ? count : 1);
+  for (i = 0; i < count; ++i) dynamic_array_push(FUNCTION_CLOSURE(o), values[i]);
+#ifdef JIT
+  /* (a template's machine code is freed if its code is replaced -- a closure compiles its own if it is hot) */
+  FUNCTION_HEAT(o) = 0;
+  FUNCTION_JIT(o) = NULL;
+#endif
   return o;
 }
 
+/* Parameters
+ * A function's locals start with its parameters: the nargs required ones, then the noptional &optional
+ * ones (NIL if they weren't given), then the &rest one (if it has one) and then, if it has optional ones,
+ * the number of required and optional arguments it was given -- which its code uses to give the optional
+ * ones that weren't their defaults. A function compiled from (function f args ...) is the same as one from
+ * (function f (&rest args) ...). See prepare_arguments.
+ *
+ * The rest list only has the arguments after the optional ones, so a call that doesn't pass any conses
+ * nothing. If the compiler found that a function's rest list can't outlive its call (see
+ * compiler-rest-reused? in lib/compiler/compile.bug), its conses are given back when the function returns
+ * (see struct frame) and reused for the next rest list.
+ */
+
+/* sets f's parameters from parameters (a make-function argument): 1 if it takes all of its arguments as
+   a list (nargs is ignored), or else its rest_kind << 1 | noptional << 3 (see function_parameters) */
+void set_function_parameters(struct object *f, ufixnum_t nargs, ufixnum_t parameters) {
+  if (parameters & 1) {
+    FUNCTION_NARGS(f) = 0;
+    FUNCTION_NOPTIONAL(f) = 0;
+    FUNCTION_REST(f) = rest_list;
+  } else {
+    FUNCTION_NARGS(f) = nargs;
+    FUNCTION_NOPTIONAL(f) = parameters >> 3;
+    FUNCTION_REST(f) = (parameters >> 1) & 3;
+  }
+}
+
+/* f's parameters (other than nargs) as one number -- how they are marshaled (a function that only has
+   required parameters is 0) */
+ufixnum_t function_parameters(struct object *f) {
+  return FUNCTION_NOPTIONAL(f) << 3 | FUNCTION_REST(f) << 1;
+}
+
+/* a list of the count values -- made of reused conses (see "Parameters") if reuse is set */
+struct object *make_rest_list(struct object **values, ufixnum_t count, char reuse) {
+  struct object *list, *o;
+  list = NIL;
+  while (count > 0) {
+    --count;
+    if (reuse && gis->vm.free_conses != NIL) {
+      o = gis->vm.free_conses;
+      gis->vm.free_conses = CONS_CDR(o);
+      CONS_CAR(o) = values[count];
+      CONS_CDR(o) = list;
+      list = o;
+    } else {
+      list = cons(values[count], list);
+    }
+  }
+  return list;
+}
+
+/* gives the conses of a rest list back to be reused */
+void free_rest_list(struct object *list) {
+  struct object *last;
+  last = list;
+  while (CONS_CDR(last) != NIL) last = CONS_CDR(last);
+  CONS_CDR(last) = gis->vm.free_conses;
+  gis->vm.free_conses = list;
+}
+
+/* Multiple values
+ * (values x y ...) in tail position compiles to return-values, which returns x and keeps the other values in
+ * gis->vm.values (up to MAX_VALUES in all -- nothing is allocated). Every other return sets gis->vm.nvalues
+ * back to 1, so right after a call the values are the ones that call returned: multiple-value-bind compiles
+ * its form's call followed by multiple-values, which pushes them. (A form that doesn't end in a call has one
+ * value -- the compiler pads the rest with nil, see compile-values in lib/compiler/compile.bug.)
+ */
+
+/* Special variables
+ * A special variable (one given to defvar, or declared special in the let that binds it) is shallow bound: its
+ * value is always in its symbol's value cell, so reading it is a symbol-value like any global. A let of one
+ * compiles to bind, which saves the old value on gis->vm.bindings and sets the new one, and its end to unbind,
+ * which puts the old values back. Each binding records the frame it was made in, so print_stack shows them
+ * with their functions -- and anything that leaves functions without returning from them (instead of quitting
+ * like PRINT_STACK_TRACE_AND_QUIT does) has to call unwind_bindings with the length the bindings had where it
+ * lands.
+ */
+
+/* gives sym the value value until the unbind_specials that ends the binding */
+void bind_special(struct object *sym, struct object *value) {
+  struct binding *binding;
+  if (gis->vm.bindings_length >= gis->vm.bindings_capacity) {
+    gis->vm.bindings_capacity *= 2;
+    gis->vm.bindings = realloc(gis->vm.bindings, sizeof(struct binding) * gis->vm.bindings_capacity);
+    if (gis->vm.bindings == NULL) {
+      printf("Failed to grow binding stack.");
+      PRINT_STACK_TRACE_AND_QUIT();
+    }
+  }
+  binding = &gis->vm.bindings[gis->vm.bindings_length++];
+  binding->symbol = sym;
+  binding->value = SYMBOL_VALUE(sym);
+  binding->value_was_set = SYMBOL_VALUE_IS_SET(sym);
+  binding->depth = gis->vm.frames_length;
+  symbol_set_value(sym, value);
+}
+
+/* ends the last count bindings (the latest first) */
+void unbind_specials(ufixnum_t count) {
+  struct binding *binding;
+  while (count > 0) {
+    binding = &gis->vm.bindings[--gis->vm.bindings_length];
+    SYMBOL_VALUE(binding->symbol) = binding->value;
+    SYMBOL_VALUE_IS_SET(binding->symbol) = binding->value_was_set;
+    --count;
+  }
+}
+
+/* ends the bindings made since there were length of them */
+void unwind_bindings(ufixnum_t length) {
+  if (gis->vm.bindings_length > length) unbind_specials(gis->vm.bindings_length - length);
+}
+
+/* prints the bindings made by the function at depth (the ones before the first length that are) -- returns
+   how many are left before them */
+ufixnum_t print_bindings(ufixnum_t length, ufixnum_t depth) {
+  struct binding *binding;
+  while (length > 0 && gis->vm.bindings[length - 1].depth >= depth) {
+    binding = &gis->vm.bindings[--length];
+    dynamic_byte_array_force_cstr(SYMBOL_NAME(binding->symbol));
+    printf("  binds %s (was ", STRING_CONTENTS(SYMBOL_NAME(binding->symbol)));
+    if (binding->value_was_set) {
+      print_no_newline(do_to_string(binding->value, 1));
+    } else {
+      printf("unbound");
+    }
+    printf(")\n");
+  }
+  return length;
+}
+
 struct object *string(char *contents) {
   struct object *o;
   ufixnum_t length;
@@ -572,6 +764,7 @@ struct object *symbol(struct object *name) {
 
   SYMBOL_NAME(o) = name;
   SYMBOL_PLIST(o) = NIL;
+  SYMBOL_DEPENDENTS(o) = NIL;
   SYMBOL_PACKAGE(o) = NIL;
   SYMBOL_IS_EXTERNAL(o) = 0;
 
@@ -651,46 +844,53 @@ void close_file(struct object *file) {
  * error handling                *
  *===============================*
  *===============================*/
+/* impl:f and impl:i are not kept up to date while bytecode is running (the
+   registers live in gis->vm). This copies the registers into them so they can be
+   inspected. */
+void materialize_vm_registers() {
+  symbol_set_value(gis->impl_f_sym, gis->vm.f);
+  symbol_set_value(gis->impl_i_sym, ufixnum(gis->vm.i));
+}
+
 int print_stack_did_recurse = 0;
 void print_stack() {
-  fixnum_t i, j, len;
-  struct object *f, *next_f;
+  ufixnum_t j, k, fp, bindings;
+  struct object *f;
   ++print_stack_did_recurse;
-  len = DYNAMIC_ARRAY_LENGTH(gis->call_stack);
-  i = len - 1;
   if (print_stack_did_recurse > 1) { /* prevent infinite recursion if the source of the error was a function called within this function */
     exit(1);
   }
-  f = symbol_get_value(gis->impl_f_sym);
+  materialize_vm_registers();
+  f = gis->vm.f;
+  fp = gis->vm.fp;
+  k = gis->vm.frames_length;
+  bindings = gis->vm.bindings_length;
   printf("Stack Trace\n");
-  while (i > 0) { /* TODO: this prints the stack in a revered order */
+  while (1) { /* TODO: this prints the stack in a revered order */
     if (f == NIL) {
       printf("Top level\n");
+      print_bindings(bindings, 0);
       break;
     } else if (type_of(f) != gis->function_type) {
       printf("Error while printing call stack. Expected a function but found: ");
       print(f);
-      print(gis->call_stack);
       exit(1);
     } else if (FUNCTION_NAME(f) != NIL) {
       dynamic_byte_array_force_cstr(SYMBOL_NAME(FUNCTION_NAME(f)));
       printf("(%s", STRING_CONTENTS(SYMBOL_NAME(FUNCTION_NAME(f))));
-      j = 0;
-      for (j = 0; j < FUNCTION_NARGS(f); ++j) {
+      for (j = 0; j < FUNCTION_NARGS(f) && fp + j < DYNAMIC_ARRAY_LENGTH(gis->data_stack); ++j) {
         printf(" ");
-        print_no_newline(do_to_string(dynamic_array_get_ufixnum_t(gis->call_stack, i - 2 - FUNCTION_STACK_SIZE(f) + j + 1), 1));
+        print_no_newline(do_to_string(DYNAMIC_ARRAY_VALUES(gis->data_stack)[fp + j], 1));
       }
     } else {
       printf("(<anonymous-function>");
     }
-    next_f = dynamic_array_get_ufixnum_t(gis->call_stack, i);
-    if (f != NIL) {
-      i -= 2; /* skip instruction index for now -- should translate this to line
-                 number later */
-      i -= FUNCTION_STACK_SIZE(f);
-      printf(")\n");
-    }
-    f = next_f;
+    printf(")\n");
+    bindings = print_bindings(bindings, k);
+    if (k == 0) break;
+    --k;
+    f = gis->vm.frames[k].f;
+    fp = gis->vm.frames[k].fp;
   }
   --print_stack_did_recurse;
 }
@@ -775,7 +975,10 @@ char equals(struct object *o0, struct object *o1) {
       return equals(FUNCTION_CONSTANTS(o0), FUNCTION_CONSTANTS(o1)) &&
              equals(FUNCTION_CODE(o0), FUNCTION_CODE(o1)) &&
              FUNCTION_STACK_SIZE(o0) == FUNCTION_STACK_SIZE(o1) &&
-             FUNCTION_NARGS(o0) == FUNCTION_NARGS(o1);
+             FUNCTION_NARGS(o0) == FUNCTION_NARGS(o1) &&
+             FUNCTION_NOPTIONAL(o0) == FUNCTION_NOPTIONAL(o1) &&
+             FUNCTION_REST(o0) == FUNCTION_REST(o1) &&
+             equals(FUNCTION_CLOSURE(o0), FUNCTION_CLOSURE(o1));
     case type_record: /* TODO */
     case type_type:
       return o0 == o1;
@@ -887,9 +1090,37 @@ void symbol_set_type(struct object *sym, struct object *t) {
   SYMBOL_TYPE_IS_SET(sym) = 1;
 }
 
+/* Inlining
+ * The compiler copies small functions into the functions that call them (see lib/compiler/inline.bug). So
+ * that redefining one of those still changes what its callers do, the compiler records each caller it
+ * inlined a function into (with impl:record-inlining) in that function's symbol's dependents: a list of
+ * (caller f fallback), where f is the caller's function that has the copy in it. When the symbol is given a
+ * different function, each caller that still has f is given fallback instead (a function that compiles the
+ * caller again the first time it is called). Frames that are running f keep running it -- only calls made
+ * after the redefinition see the change.
+ */
+
+/* gives the callers that have sym's function inlined their fallbacks (see "Inlining") */
+void deoptimize_dependents(struct object *sym) {
+  struct object *cursor, *dependent;
+  cursor = SYMBOL_DEPENDENTS(sym);
+  SYMBOL_DEPENDENTS(sym) = NIL;
+  while (cursor != NIL) {
+    dependent = CONS_CAR(cursor);
+    /* (a caller that was defined again since doesn't have the copy anymore) */
+    if (SYMBOL_FUNCTION(CONS_CAR(dependent)) == CONS_CAR(CONS_CDR(dependent)))
+      symbol_set_function(CONS_CAR(dependent), CONS_CAR(CONS_CDR(CONS_CDR(dependent))));
+    cursor = CONS_CDR(cursor);
+  }
+}
+
 void symbol_set_function(struct object *sym, struct object *f) {
+  /* (the same definition again -- like the one compiling a file gives it before running the file -- changes
+     nothing its callers have inlined) */
+  if (SYMBOL_DEPENDENTS(sym) != NIL && !equals(SYMBOL_FUNCTION(sym), f)) deoptimize_dependents(sym);
   SYMBOL_FUNCTION(sym) = f;
   SYMBOL_FUNCTION_IS_SET(sym) = 1;
+  ++gis->function_epoch; /* invalidates every call_cache */
 }
 
 void symbol_set_value(struct object *sym, struct object *value) {
@@ -974,7 +1205,7 @@ struct object *intern(struct object *string, struct object *package) {
  *  which is set to the current package.
  */
 void gis_init(char load_core) {
-  struct object *repl;
+  struct object *repl, *bc;
   char is_reload = 0;
   if (gis == NULL) {
     gis = malloc(sizeof(struct gis));
@@ -982,6 +1213,7 @@ void gis_init(char load_core) {
       printf("Failed to allocate global interpreter state.");
       exit(1);
     }
+    gis->function_epoch = 1; /* zeroed call caches have epoch 0, so they start out invalid */
   } else {
     is_reload = 1;
   }
@@ -1000,6 +1232,7 @@ void gis_init(char load_core) {
   NIL = symbol(string("nil"));
   /* All fields that are initialied to NIL must be re-initialized to NIL here because we just defined what NIL is */
   SYMBOL_PLIST(NIL) = NIL;
+  SYMBOL_DEPENDENTS(NIL) = NIL;
   SYMBOL_FUNCTION(NIL) = NIL;
   SYMBOL_PACKAGE(NIL) = NIL;
   SYMBOL_TYPE(NIL) = NIL;
@@ -1040,11 +1273,10 @@ void gis_init(char load_core) {
   M_SYM(byte_stream_read, "byte-stream-read", impl);
   M_SYM(byte_stream_has, "byte-stream-has", impl);
   M_SYM(call, "call", impl);
-  M_SYM(call_stack, "call-stack", impl); /** stack for saving stack pointers and values for function calls (a cons list) */
   M_SYM(change_directory, "change-directory", impl);
   M_SYM(close_file, "close-file", impl); 
   M_SYM(continue, "continue", impl); 
-  M_SYM(data_stack, "data-stack", impl); /** the data stack (a cons list) */
+  M_SYM(data_stack, "data-stack", impl); /** the data stack (a dynamic array) */
   M_SYM(debugger, "debugger", impl);
   M_SYM(define_function, "define-function", impl);
   M_SYM(define_struct, "define-struct", impl);
@@ -1077,9 +1309,12 @@ void gis_init(char load_core) {
   M_SYM(push, "push", impl);
   M_SYM(read_bytecode_file, "read-bytecode-file", impl);
   M_SYM(read_file, "read-file", impl);
+  M_SYM(define_inline, "define-inline", impl);
+  M_SYM(record_inlining, "record-inlining", impl);
   M_SYM(strings, "strings", impl);
   M_SYM(string_concat, "string-concat", impl);
   M_SYM(set_struct_field, "set-struct-field", impl);
+  M_SYM(set_symbol_property, "set-symbol-property", impl);
   M_SYM(symbol_type, "symbol-type", impl);
   M_SYM(type_of, "type-of", impl);
   M_SYM(unmarshal, "unmarshal", impl);
@@ -1108,6 +1343,7 @@ void gis_init(char load_core) {
   M_SYM(fbound, "fbound?", lisp);
   M_SYM(function_macro, "function-macro?", lisp);
   M_SYM(if, "if", lisp);
+  M_SYM(inline, "inline", lisp);
   M_SYM(intern, "intern", lisp);
   M_SYM(lt, "<", lisp);
   M_SYM(list, "list", lisp);
@@ -1132,6 +1368,8 @@ void gis_init(char load_core) {
   M_SYM(shift_left, "<<", lisp);
   M_SYM(shift_right, ">>", lisp);
   M_SYM(symbol_name, "symbol-name", lisp);
+  M_SYM(symbol_plist, "symbol-plist", lisp);
+  M_SYM(symbol_property, "symbol-property", lisp);
   M_SYM(symbol_function, "symbol-function", lisp);
   M_SYM(symbol_value, "symbol-value", lisp);
   M_SYM(symbol_value_set, "symbol-value?", lisp);
@@ -1250,88 +1488,11 @@ void gis_init(char load_core) {
   GIS_UNINSTANTIATABLE_TYPE(gis->uint_type, gis->type_uint_sym);
   GIS_UNINSTANTIATABLE_TYPE(gis->object_type, gis->type_object_sym);
 
-#define GIS_BUILTIN(builtin, sym, nargs) \
-  builtin = function(NIL, NIL, nargs);   \
-  FUNCTION_IS_BUILTIN(builtin) = 1;      \
-  FUNCTION_NARGS(builtin) = nargs;       \
-  FUNCTION_NAME(builtin) = sym;          \
-  symbol_set_function(FUNCTION_NAME(builtin), builtin);
-
-#define GIS_BUILTIN_S(builtin, package, symbol_name, nargs)   \
-  GIS_BUILTIN(builtin, symbol(string(symbol_name)), nargs);   \
-  SYMBOL_PACKAGE(FUNCTION_NAME(builtin)) = package;                              \
-  PACKAGE_SYMBOLS(package) =                                  \
-      cons(FUNCTION_NAME(builtin), PACKAGE_SYMBOLS(package)); \
-  symbol_export(FUNCTION_NAME(builtin));
-
-  /* all builtin functions go here */
-  GIS_BUILTIN(gis->alloc_struct_builtin, gis->impl_alloc_struct_sym, 1);
-  GIS_BUILTIN(gis->apply_builtin, gis->lisp_apply_sym, 2);
-  GIS_BUILTIN(gis->byte_stream_builtin, gis->impl_byte_stream_sym, 1);
-  GIS_BUILTIN(gis->byte_stream_peek_builtin, gis->impl_byte_stream_peek_sym, 2);
-  GIS_BUILTIN(gis->byte_stream_peek_byte_builtin, gis->impl_byte_stream_peek_byte_sym, 1);
-  GIS_BUILTIN(gis->byte_stream_read_builtin, gis->impl_byte_stream_read_sym, 2);
-  GIS_BUILTIN(gis->byte_stream_has_builtin, gis->impl_byte_stream_has_sym, 1);
-  GIS_BUILTIN(gis->debugger_builtin, gis->impl_debugger_sym, 0);
-  GIS_BUILTIN(gis->dynamic_byte_array_as_string_builtin, gis->impl_dynamic_byte_array_as_string_sym, 1);
-  GIS_BUILTIN(gis->dynamic_array_builtin, gis->type_dynamic_array_sym, 1);
-  GIS_BUILTIN_S(gis->dynamic_array_get_builtin, gis->impl_package, "dynamic-array-get", 2);
-  PACKAGE_SYMBOLS(gis->lisp_package) = cons(FUNCTION_NAME(gis->dynamic_array_get_builtin), PACKAGE_SYMBOLS(gis->lisp_package));
-  GIS_BUILTIN(gis->dynamic_array_set_builtin, gis->lisp_dynamic_array_set_sym, 3);
-  GIS_BUILTIN(gis->dynamic_array_length_builtin, gis->lisp_dynamic_array_length_sym, 1);
-  GIS_BUILTIN(gis->dynamic_array_push_builtin, gis->lisp_dynamic_array_push_sym, 2);
-  GIS_BUILTIN(gis->dynamic_array_pop_builtin, gis->lisp_dynamic_array_pop_sym, 1);
-  GIS_BUILTIN(gis->dynamic_array_concat_builtin, gis->lisp_dynamic_array_concat_sym, 2);
-  GIS_BUILTIN(gis->dynamic_byte_array_builtin, gis->type_dynamic_byte_array_sym, 1);
-  GIS_BUILTIN(gis->dynamic_byte_array_concat_builtin, gis->impl_dynamic_byte_array_concat_sym, 2);
-  GIS_BUILTIN(gis->dynamic_byte_array_get_builtin, gis->impl_dynamic_byte_array_get_sym, 2);
-  GIS_BUILTIN(gis->dynamic_byte_array_insert_builtin, gis->impl_dynamic_byte_array_insert_sym, 3);
-  GIS_BUILTIN(gis->dynamic_byte_array_length_builtin, gis->impl_dynamic_byte_array_length_sym, 1);
-  GIS_BUILTIN(gis->dynamic_byte_array_set_builtin, gis->impl_dynamic_byte_array_set_sym, 3);
-  GIS_BUILTIN(gis->dynamic_byte_array_push_builtin, gis->impl_dynamic_byte_array_push_sym, 2);
-  GIS_BUILTIN(gis->dynamic_byte_array_pop_builtin, gis->impl_dynamic_byte_array_pop_sym, 1);
-  GIS_BUILTIN(gis->change_directory_builtin, gis->impl_change_directory_sym, 1) /* takes the new directory */
-  GIS_BUILTIN(gis->close_file_builtin, gis->impl_close_file_sym, 1);
-  GIS_BUILTIN(gis->dynamic_library_builtin, gis->type_dynamic_library_sym, 1)  /* takes the path */
-  GIS_BUILTIN(gis->get_current_working_directory_builtin, gis->impl_get_current_working_directory_sym, 0)
-  GIS_BUILTIN(gis->gensym_builtin, gis->lisp_gensym_sym, 0)
-  GIS_BUILTIN(gis->fbound_builtin, gis->lisp_fbound_sym, 1);
-  GIS_BUILTIN(gis->function_macro_builtin, gis->lisp_function_macro_sym, 1);
-  GIS_BUILTIN(gis->find_package_builtin, gis->lisp_find_package_sym, 1);
-  GIS_BUILTIN(gis->find_symbol_builtin, gis->lisp_find_symbol_sym, 2);
-  GIS_BUILTIN(gis->foreign_function_builtin, gis->type_foreign_function_sym, 4) /* takes the dlib, the name, and the parameter types */
-  GIS_BUILTIN(gis->function_code_builtin, gis->impl_function_code_sym, 1)
-  GIS_BUILTIN(gis->intern_builtin, gis->lisp_intern_sym, 2);
-  GIS_BUILTIN(gis->make_function_builtin, gis->impl_make_function_sym, 8);
-  GIS_BUILTIN(gis->make_symbol_builtin, gis->lisp_make_symbol_sym, 1);
-  GIS_BUILTIN(gis->make_package_builtin, gis->lisp_make_package_sym, 3);
-  GIS_BUILTIN(gis->marshal_builtin, gis->impl_marshal_sym, 2);
-  GIS_BUILTIN(gis->marshal_integer_builtin, gis->impl_marshal_integer_sym, 3);
-  GIS_BUILTIN(gis->open_file_builtin, gis->impl_open_file_sym, 2);
-  GIS_BUILTIN(gis->package_symbols_builtin, gis->lisp_package_symbols_sym, 1);
-  GIS_BUILTIN(gis->package_name_builtin, gis->lisp_package_name_sym, 1);
-  GIS_BUILTIN(gis->type_of_builtin, gis->impl_type_of_sym, 1)
-  GIS_BUILTIN(gis->read_bytecode_file_builtin, gis->impl_read_bytecode_file_sym, 1);
-  GIS_BUILTIN(gis->read_file_builtin, gis->impl_read_file_sym, 1);
-  GIS_BUILTIN(gis->define_struct_builtin, gis->impl_define_struct_sym, 2);
-  GIS_BUILTIN(gis->symbol_name_builtin, gis->lisp_symbol_name_sym, 1);
-  GIS_BUILTIN(gis->symbol_type_builtin, gis->impl_symbol_type_sym, 1);
-  GIS_BUILTIN(gis->symbol_value_set_builtin, gis->lisp_symbol_value_set_sym, 1);
-  GIS_BUILTIN(gis->string_concat_builtin, gis->impl_string_concat_sym, 2);
-  GIS_BUILTIN(gis->struct_field_builtin, gis->impl_struct_field_sym, 2);
-  GIS_BUILTIN(gis->set_struct_field_builtin, gis->impl_set_struct_field_sym, 3);
-  GIS_BUILTIN(gis->to_string_builtin, gis->lisp_to_string_sym, 1);
-  GIS_BUILTIN(gis->unmarshal_builtin, gis->impl_unmarshal_sym, 1);
-  GIS_BUILTIN(gis->use_package_builtin, gis->impl_use_package_sym, 1) /* takes name of package */
-  GIS_BUILTIN(gis->write_bytecode_file_builtin, gis->impl_write_bytecode_file_sym, 2);
-  GIS_BUILTIN(gis->write_file_builtin, gis->impl_write_file_sym, 2);
-  GIS_BUILTIN(gis->write_image_builtin, gis->impl_write_image_sym, 1);
+  init_builtins();
 
   /* initialize set interpreter state */
-  gis->data_stack = dynamic_array(10);
+  gis->data_stack = dynamic_array(64);
   symbol_set_value(BSYM(impl, data_stack), gis->data_stack);
-  gis->call_stack = dynamic_array(10);
-  symbol_set_value(BSYM(impl, call_stack), gis->call_stack); /* using a dynamic array to make looking up arguments on the stack faster */
 
   symbol_set_value(BSYM(lisp, package), BPAC(user));
   symbol_set_value(BSYM(impl, packages),
@@ -1341,12 +1502,29 @@ void gis_init(char load_core) {
                           cons(BPAC(impl),
                             cons(BPAC(type), NIL))))));
 
-  symbol_set_value(BSYM(impl, f), NIL); /* the function being executed */
-  symbol_set_value(BSYM(impl, i), ufixnum(0)); /* the instruction index */
-
-  /* i've found this to be an easy solution to solving an issue with looking up locals. I put the function at the top of the call-stack (makes it easy to pop off items) but it makes it harder to handle set_locals get_locals */
-  dynamic_array_push(gis->call_stack, NIL);
-    dynamic_array_push(gis->call_stack, NIL);
+  gis->vm.f = NIL; /* the function being executed */
+  gis->vm.i = 0; /* the instruction index */
+  gis->vm.fp = 0;
+  gis->vm.frames_capacity = 16;
+  gis->vm.frames_length = 0;
+  gis->vm.frames = malloc(sizeof(struct frame) * gis->vm.frames_capacity);
+  if (gis->vm.frames == NULL) {
+    printf("Failed to allocate call stack.");
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  gis->vm.free_conses = NIL;
+  gis->vm.nvalues = 1;
+  gis->vm.bindings_capacity = 16;
+  gis->vm.bindings_length = 0;
+  gis->vm.bindings = malloc(sizeof(struct binding) * gis->vm.bindings_capacity);
+  if (gis->vm.bindings == NULL) {
+    printf("Failed to allocate binding stack.");
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  gis->vm.retired = NULL;
+  gis->vm.retired_length = 0;
+  gis->vm.retired_capacity = 0;
+  materialize_vm_registers();
 
   gis->standard_out = file_stdout();
   gis->standard_in = file_stdin();
@@ -1359,7 +1537,11 @@ void gis_init(char load_core) {
   /* Load core.bug */
   gis->loaded_core = 0;
   if (load_core) {
-    eval(read_bytecode_file(open_file(string("../bootstrap/compiler.bc"), string("rb"))), NIL);
+    bc = read_bytecode_file(open_file(string("../bootstrap/compiler.bc"), string("rb")));
+#ifdef AOT
+    aot_load(bc, AOT_COMPILER_LIBRARY);
+#endif
+    eval(bc, NIL);
     repl = find_symbol(string("repl"), gis->user_package, 1);
     if (!SYMBOL_FUNCTION_IS_SET(repl)) {
       printf("You the compiler must have a function called 'repl'.");
@@ -1390,6 +1572,10 @@ void flonum_convert(struct object *o) {
   if (t == gis->flonum_type) {
     return;
   } else if (t == gis->fixnum_type) {
+    if (IS_IMMEDIATE_FIXNUM(o)) {
+      printf("Cannot convert an immediate fixnum to a flonum in place.");
+      PRINT_STACK_TRACE_AND_QUIT();
+    }
     OBJECT_TYPE(o) = type_flonum;
     FLONUM_VALUE(o) = FIXNUM_VALUE(o);
     return;
@@ -1465,12 +1651,42 @@ struct object *read_file(struct object *file) {
   return dba;
 }
 
+/* saves the registers of a caller in a new frame record (see struct frame) */
+void push_frame(struct object *f, ufixnum_t i, ufixnum_t fp) {
+  struct frame *frame;
+  if (gis->vm.frames_length >= gis->vm.frames_capacity) {
+    gis->vm.frames_capacity *= 2;
+    gis->vm.frames = realloc(gis->vm.frames, sizeof(struct frame) * gis->vm.frames_capacity);
+    if (gis->vm.frames == NULL) {
+      printf("Failed to grow call stack.");
+      PRINT_STACK_TRACE_AND_QUIT();
+    }
+  }
+  frame = &gis->vm.frames[gis->vm.frames_length++];
+  frame->f = f;
+  frame->i = i;
+  frame->fp = fp;
+  frame->rest = NIL;
+}
+
+/* sets the locals of f that come after its nargs arguments to NIL (all at once), and
+   drops anything that was above them (the data stack ends with f's locals) */
+void init_locals(struct object *f, ufixnum_t fp, ufixnum_t nargs) {
+  ufixnum_t j, stack_size;
+  struct object **values;
+  stack_size = FUNCTION_STACK_SIZE(f) < nargs ? nargs : FUNCTION_STACK_SIZE(f);
+  if (fp + stack_size > DYNAMIC_ARRAY_LENGTH(gis->data_stack))
+    dynamic_array_reserve(gis->data_stack, fp + stack_size - DYNAMIC_ARRAY_LENGTH(gis->data_stack));
+  values = DYNAMIC_ARRAY_VALUES(gis->data_stack) + fp;
+  for (j = nargs; j < stack_size; ++j) values[j] = NIL;
+  DYNAMIC_ARRAY_LENGTH(gis->data_stack) = fp + stack_size;
+}
+
 /* evaluates the given bytecode starting at the given instruction index */
 struct object *eval_at_instruction(struct object *f, ufixnum_t i, struct object *args) {
-  ufixnum_t j;
+  ufixnum_t j, fp;
   struct object *cursor;
-  symbol_set_value(gis->impl_f_sym, f);
-  UFIXNUM_VALUE(symbol_get_value(gis->impl_i_sym)) = i;
+  fp = DYNAMIC_ARRAY_LENGTH(gis->data_stack);
   j = 0;
   cursor = args;
   while (j < FUNCTION_NARGS(f)) {
@@ -1478,14 +1694,15 @@ struct object *eval_at_instruction(struct object *f, ufixnum_t i, struct object
       printf("Not enough arguments provided. Expected %lu but got %lu.\n", (unsigned long)FUNCTION_NARGS(f), (unsigned long)j); 
       PRINT_STACK_TRACE_AND_QUIT();
     }
-    dynamic_array_push(gis->call_stack, CONS_CAR(cursor));
+    dynamic_array_push(gis->data_stack, CONS_CAR(cursor));
     cursor = CONS_CDR(cursor);
     ++j;
   }
-  /* prepare the call stack by making room for stack args */
-  /* TODO: this can be optimized to just increment the length instead of pushing NILs */
-  for (j = 0; j < FUNCTION_STACK_SIZE(f) - FUNCTION_NARGS(f); ++j)
-    dynamic_array_push(gis->call_stack, NIL);
+  init_locals(f, fp, FUNCTION_NARGS(f));
+  push_frame(NIL, 0, gis->vm.fp); /* returning from f goes back to the top level */
+  gis->vm.f = f;
+  gis->vm.i = i;
+  gis->vm.fp = fp;
   return run(gis);
 }
 /* evaluates the bytecode starting at instruction index 0 */
@@ -1497,7 +1714,10 @@ struct object *eval(struct object *bc, struct object* args) {
  * Bytecode Interpreter
  */
 void push(struct object *object) {
-  dynamic_array_push(gis->data_stack, object);
+  struct dynamic_array *stack;
+  stack = gis->data_stack->w1.value.dynamic_array;
+  if (stack->length >= stack->capacity) dynamic_array_ensure_capacity(gis->data_stack);
+  stack->values[stack->length++] = object;
 }
 
 struct object *pop() {
@@ -1516,580 +1736,2566 @@ void dup() {
           gis->data_stack)[DYNAMIC_ARRAY_LENGTH(gis->data_stack) - 1]);
 }
 
-#define GET_LOCAL(n)                          \
-  dynamic_array_get_ufixnum_t(                \
-      gis->call_stack,                        \
-      DYNAMIC_ARRAY_LENGTH(gis->call_stack) - \
-          (FUNCTION_STACK_SIZE(symbol_get_value(gis->impl_f_sym)) + 2 - (n)))
+/* Builtins
+ * A builtin is a function object (FUNCTION_IS_BUILTIN) whose code is a C function in the builtins
+ * table (at FUNCTION_BUILTIN_INDEX). Every builtin takes its arguments as an array -- the locals of
+ * its frame on the data stack -- and returns its result. The args pointer is only valid until
+ * something is pushed to the data stack (pushing can move it).
+ */
+#define MAX_BUILTINS 256
+static builtin_fn builtins[MAX_BUILTINS];
+static ufixnum_t builtins_length = 0;
+
+/* makes a builtin function that runs fn, and sets it as the function of the symbol name
+   (fn can be NULL for a builtin that isn't implemented yet) */
+struct object *register_builtin(struct object *name, ufixnum_t nargs, builtin_fn fn) {
+  struct object *f;
+  if (builtins_length >= MAX_BUILTINS) {
+    printf("Too many builtins (the maximum is %d).\n", MAX_BUILTINS);
+    exit(1);
+  }
+  f = function(NIL, NIL, nargs);
+  FUNCTION_IS_BUILTIN(f) = 1;
+  FUNCTION_BUILTIN_INDEX(f) = builtins_length;
+  FUNCTION_NARGS(f) = nargs;
+  FUNCTION_NAME(f) = name;
+  symbol_set_function(name, f);
+  builtins[builtins_length++] = fn;
+  return f;
+}
 
-/* minus two to skip the f and i */
-#define SET_LOCAL(n, x)                                                     \
-  dynamic_array_set_ufixnum_t(                                              \
-      gis->call_stack,                                                      \
-      DYNAMIC_ARRAY_LENGTH(gis->call_stack) -                               \
-          (FUNCTION_STACK_SIZE(symbol_get_value(gis->impl_f_sym)) + 2 - (n)), \
-      (x))
+struct object *builtin_use_package(struct object **args, ufixnum_t nargs) {
+  /* TODO */
+  return NIL;
+}
 
-/** evaluates a builtin function */
-void eval_builtin(struct object *f) {
-  struct object *t0, *t1;
-  if (f == gis->use_package_builtin) {
-    /* TODO */
-  } else if (f == gis->fbound_builtin) {
-    OT("fbound?", 0, GET_LOCAL(0), type_symbol);
-    push(SYMBOL_FUNCTION_IS_SET(GET_LOCAL(0)) ? T : NIL);
-  } else if (f == gis->function_macro_builtin) {
-    push((OBJECT_TYPE(f) == type_function && FUNCTION_IS_MACRO(GET_LOCAL(0))) ? T : NIL);
-  } else if (f == gis->find_package_builtin) {
-    push(find_package(string_designator(GET_LOCAL(0))));
-  } else if (f == gis->symbol_type_builtin) {
-    push(symbol_get_type(GET_LOCAL(0)));
-  } else if (f == gis->type_of_builtin) {
-    push(type_of(GET_LOCAL(0)));
-  } else if (f == gis->dynamic_byte_array_as_string_builtin) {
-    OBJECT_TYPE(GET_LOCAL(0)) = type_string;
-    push(GET_LOCAL(0));
-  } else if (f == gis->dynamic_array_builtin) {
-    OT("dynamic-array", 0, GET_LOCAL(0), type_fixnum);
-    push(dynamic_array(FIXNUM_VALUE(GET_LOCAL(0))));
-  } else if (f == gis->dynamic_byte_array_builtin) {
-    OT("dynamic-byte-array", 0, GET_LOCAL(0), type_fixnum);
-    push(dynamic_byte_array(FIXNUM_VALUE(GET_LOCAL(0))));
-  } else if (f == gis->to_string_builtin) {
-    push(to_string(GET_LOCAL(0)));
-  } else if (f == gis->symbol_value_set_builtin) {
-    OT("symbol-value?", 0, GET_LOCAL(0), type_symbol);
-    push(SYMBOL_VALUE_IS_SET(GET_LOCAL(0)) ? T : NIL);
-  } else if (f == gis->dynamic_array_get_builtin) {
-    push(dynamic_array_get(GET_LOCAL(0), GET_LOCAL(1)));
-  } else if (f == gis->dynamic_array_set_builtin) {
-    dynamic_array_set(GET_LOCAL(0), GET_LOCAL(1), GET_LOCAL(2));
-    push(NIL);
-  } else if (f == gis->dynamic_array_length_builtin) {
-    push(dynamic_array_length(GET_LOCAL(0)));
-  } else if (f == gis->write_image_builtin) {
-    write_image(GET_LOCAL(0));
-    push(NIL);
-  } else if (f == gis->dynamic_array_push_builtin) {
-    dynamic_array_push(GET_LOCAL(0), GET_LOCAL(1));
-    push(NIL);
-  } else if (f == gis->dynamic_array_pop_builtin) {
-    push(dynamic_array_pop(GET_LOCAL(0)));
-  } else if (f == gis->dynamic_array_concat_builtin) {
-    push(dynamic_array_concat(GET_LOCAL(0), GET_LOCAL(1)));
-  } else if (f == gis->dynamic_byte_array_concat_builtin) {
-    push(dynamic_byte_array_concat(GET_LOCAL(0), GET_LOCAL(1)));
-  } else if (f == gis->dynamic_byte_array_get_builtin) {
-    OT("dynamic-byte-array-get", 1, GET_LOCAL(1), type_fixnum);
-    push(fixnum(dynamic_byte_array_get(GET_LOCAL(0), FIXNUM_VALUE(GET_LOCAL(1)))));
-  } else if (f == gis->dynamic_byte_array_insert_builtin) {
-    OT("dynamic-byte-array-insert", 1, GET_LOCAL(1), type_fixnum);
-    OT("dynamic-byte-array-insert", 2, GET_LOCAL(2), type_fixnum);
-    dynamic_byte_array_insert_char(GET_LOCAL(0), FIXNUM_VALUE(GET_LOCAL(1)), FIXNUM_VALUE(GET_LOCAL(2)));
-    push(NIL);
-  } else if (f == gis->dynamic_byte_array_length_builtin) {
-    push(dynamic_byte_array_length(GET_LOCAL(0)));
-  } else if (f == gis->dynamic_byte_array_set_builtin) {
-    OT("dynamic-byte-array-set", 1, GET_LOCAL(1), type_fixnum);
-    OT("dynamic-byte-array-set", 2, GET_LOCAL(2), type_fixnum);
-    dynamic_byte_array_set(GET_LOCAL(0), FIXNUM_VALUE(GET_LOCAL(1)), FIXNUM_VALUE(GET_LOCAL(2)));
-    push(NIL);
-  } else if (f == gis->dynamic_byte_array_push_builtin) {
-    push(dynamic_byte_array_push(GET_LOCAL(0), GET_LOCAL(1)));
-  } else if (f == gis->dynamic_byte_array_pop_builtin) {
-    push(dynamic_byte_array_pop(GET_LOCAL(0)));
-  } else if (f == gis->define_struct_builtin) {
-    push(type(GET_LOCAL(0), GET_LOCAL(1), 1, 0));
-  } else if (f == gis->change_directory_builtin) {
-    change_directory(GET_LOCAL(0));
-    push(NIL);
-  } else if (f == gis->get_current_working_directory_builtin) {
-    push(get_current_working_directory());
-  } else if (f == gis->alloc_struct_builtin) {
-    push(alloc_struct(GET_LOCAL(0), 1));
-  } else if (f == gis->gensym_builtin) {
-    push(symbol(string_concat(string("gensym-"), to_string(ufixnum(gis->gensym_counter)))));
-    ++gis->gensym_counter;
-  } else if (f == gis->function_code_builtin) {
-    OT("function-code", 0, GET_LOCAL(0), type_function);
-    push(FUNCTION_CODE(GET_LOCAL(0)));
-  } else if (f == gis->apply_builtin) {
-    OT_LIST("apply", 1, GET_LOCAL(1));
-    t0 = GET_LOCAL(0);
-    if (type_of(t0) == gis->symbol_type) {
-      t0 = symbol_get_function(t0);
-    }
-    if (type_of(t0) != gis->function_type) {
-      printf("Apply must be given a function or symbol that has a function.\n");
-      PRINT_STACK_TRACE_AND_QUIT();
-    }
-    t1 = GET_LOCAL(1); /* we must store the local now -- as we will be setting f/i to NIL */
-    symbol_set_value(gis->impl_f_sym, NIL);
-    symbol_set_value(gis->impl_i_sym, NIL);
-    push(call_function(t0, t1));
-    symbol_set_value(gis->impl_f_sym, gis->apply_builtin); /* we must restore this before returning so that op_return knows we are returning from apply */
-    /* (render-html `(div ((a 3) (b 1)) (span) (span "hello")))
-      There is a big call-stack leak and a small data-stack leak. why?!
-      it seems to only happen when  a string is passed 
-    */
-  } else if (f == gis->struct_field_builtin) {
-    push(struct_field(GET_LOCAL(0), GET_LOCAL(1)));
-  } else if (f == gis->set_struct_field_builtin) {
-    set_struct_field(GET_LOCAL(0), GET_LOCAL(1), GET_LOCAL(2));
-    push(NIL);
-  } else if (f == gis->symbol_name_builtin) {
-    OT("symbol-name", 0, GET_LOCAL(0), type_symbol);
-    push(SYMBOL_NAME(GET_LOCAL(0)));
-  } else if (f == gis->dynamic_library_builtin) {
-    push(dlib(GET_LOCAL(0)));
-  } else if (f == gis->byte_stream_builtin) {
-    push(byte_stream_lift(GET_LOCAL(0)));
-  } else if (f == gis->byte_stream_peek_builtin) {
-    push(byte_stream_peek(GET_LOCAL(0), FIXNUM_VALUE(GET_LOCAL(1)))); /* TODO: support more than just fixnum */
-  } else if (f == gis->byte_stream_peek_byte_builtin) {
-    push(fixnum(byte_stream_peek_byte(GET_LOCAL(0))));
-  } else if (f == gis->byte_stream_has_builtin) {
-    push(byte_stream_has(GET_LOCAL(0)) ? T : NIL);
-  } else if (f == gis->byte_stream_read_builtin) {
-    push(byte_stream_read(GET_LOCAL(0), FIXNUM_VALUE(GET_LOCAL(1)))); /* TODO: support more than just fixnum */
-  } else if (f == gis->close_file_builtin) {
-    close_file(GET_LOCAL(0));
-    push(NIL);
-  } else if (f == gis->open_file_builtin) {
-    push(open_file(GET_LOCAL(0), GET_LOCAL(1)));
-  } else if (f == gis->read_bytecode_file_builtin) {
-    push(read_bytecode_file(GET_LOCAL(0)));
-  } else if (f == gis->read_file_builtin) {
-    push(read_file(GET_LOCAL(0)));
-  } else if (f == gis->marshal_builtin) {
-    push(marshal(GET_LOCAL(0), GET_LOCAL(1), NULL));
-  } else if (f == gis->marshal_integer_builtin) {
-    push(marshal_ufixnum(GET_LOCAL(0), GET_LOCAL(1), GET_LOCAL(2) == NIL ? 0 : 1));
-  } else if (f == gis->unmarshal_builtin) {
-    push(unmarshal(GET_LOCAL(0), NULL));
-  } else if (f == gis->write_bytecode_file_builtin) {
-    write_bytecode_file(GET_LOCAL(0), GET_LOCAL(1));
-    push(NIL);
-  } else if (f == gis->write_file_builtin) {
-    write_file(GET_LOCAL(0), GET_LOCAL(1));
-    push(NIL);
-  } else if (f == gis->string_concat_builtin) {
-    push(string_concat_external(GET_LOCAL(0), GET_LOCAL(1)));
-  } else if (f == gis->foreign_function_builtin) {
-    push(foreign_function(GET_LOCAL(0), GET_LOCAL(1), GET_LOCAL(2), GET_LOCAL(3)));
-  } else if (f == gis->package_symbols_builtin) {
-    OT("package-symbols", 0, GET_LOCAL(0), type_package);
-    push(PACKAGE_SYMBOLS(GET_LOCAL(0)));
-  } else if (f == gis->intern_builtin) {
-    OT("intern", 0, GET_LOCAL(0), type_string);
-    OT("intern", 1, GET_LOCAL(1), type_package);
-    push(intern(GET_LOCAL(0), GET_LOCAL(1)));
-  } else if (f == gis->make_symbol_builtin) {
-    OT("make-symbol", 0, GET_LOCAL(0), type_string);
-    push(symbol(GET_LOCAL(0)));
-  } else if (f == gis->package_name_builtin) {
-    OT("package-name", 0, GET_LOCAL(0), type_package);
-    push(PACKAGE_NAME(GET_LOCAL(0)));
-  } else if (f == gis->package_symbols_builtin) {
-    OT("package-symbols", 0, GET_LOCAL(0), type_package);
-    push(PACKAGE_SYMBOLS(GET_LOCAL(0)));
-  } else if (f == gis->make_function_builtin) {
-    OT("make-function", 0, GET_LOCAL(0), type_symbol); /* name */
-    OT2("make-function", 1, GET_LOCAL(1), type_string, type_symbol); /* docstring - string or nil*/
-    OT("make-function", 2, GET_LOCAL(2), type_fixnum); /* stack size */
-    OT("make-function", 3, GET_LOCAL(3), type_fixnum); /* nargs */
-    /* local 4 - accepts all */
-    /* local 5 - is macro */
-    OT("make-function", 6, GET_LOCAL(6), type_dynamic_byte_array); /* code */
-    OT("make-function", 7, GET_LOCAL(7), type_dynamic_array); /* constants */
-
-    t0 = function(GET_LOCAL(7), GET_LOCAL(6), FIXNUM_VALUE(GET_LOCAL(2)));
-    FUNCTION_NAME(t0) = GET_LOCAL(0);
-    FUNCTION_DOCSTRING(t0) = GET_LOCAL(1);
-    FUNCTION_NARGS(t0) = FIXNUM_VALUE(GET_LOCAL(3));
-    FUNCTION_IS_MACRO(t0) = GET_LOCAL(5) == NIL ? 0 : 1;
-    FUNCTION_ACCEPTS_ALL(t0) = GET_LOCAL(4) == NIL ? 0 : 1;
-    push(t0);
-  } else if (f == gis->find_symbol_builtin) {
-    OT("find-symbol", 0, GET_LOCAL(0), type_string);
-    OT("find-symbol", 0, GET_LOCAL(1), type_package);
-    push(find_symbol(GET_LOCAL(0), GET_LOCAL(1), 1));
-  } else if (f == gis->make_package_builtin) {
-    OT("make-package", 0, GET_LOCAL(0), type_string);
-    /* arg 1 is not used - reserved for implementing package nicknames later */
-    OT_LIST("make-package", 2, GET_LOCAL(2)); /* use package list */
-    /* TODO check for naming conflicts */
-    t0 = package(GET_LOCAL(0));
-    t1 = GET_LOCAL(2);
-    while (t1 != NIL) {
-      use_package(t0, CONS_CAR(t1));
-      t1 = CONS_CDR(t1);
-    }
-    push(t0);
-  } else {
-    printf("Unknown builtin\n");
-    print(f);
-    PRINT_STACK_TRACE_AND_QUIT();
-  }
+struct object *builtin_fbound(struct object **args, ufixnum_t nargs) {
+  OT("fbound?", 0, args[0], type_symbol);
+  return SYMBOL_FUNCTION_IS_SET(args[0]) ? T : NIL;
 }
 
-/* (7F)_16 is (0111 1111)_2, it extracts the numerical value from the temporary
- */
-/* (80)_16 is (1000 0000)_2, it extracts the flag from the temporary */
-#define READ_OP_ARG()                                                  \
-  if (UFIXNUM_VALUE(i) >= byte_count) {                                \
-    printf("BC: expected an op code argument, but bytecode ended.\n"); \
-    break;                                                             \
-  }                                                                    \
-  t0 = code->bytes[++UFIXNUM_VALUE(i)];                                \
-  a0 = t0 & 0x7F;                                                      \
-  op_arg_byte_count = 1;                                               \
-  while (t0 & 0x80) {                                                  \
-    if (UFIXNUM_VALUE(i) >= byte_count) {                              \
-      printf(                                                          \
-          "BC: expected an extended op code argument, but bytecode "   \
-          "ended.\n");                                                 \
-      break;                                                           \
-    }                                                                  \
-    t0 = code->bytes[++UFIXNUM_VALUE(i)];                              \
-    a0 = ((t0 & 0x7F) << (7 * op_arg_byte_count++)) | a0;              \
-  }
-
-#define READ_OP_JUMP_ARG()                                     \
-  sa0 = code->bytes[++UFIXNUM_VALUE(i)] << 8; \
-  sa0 = code->bytes[++UFIXNUM_VALUE(i)] | sa0;
-
-#define READ_CONST_ARG()                                               \
-  READ_OP_ARG()                                                        \
-  if (a0 >= constants_length) {                                        \
-    printf(                                                            \
-        "BC: bytecode attempted to access an out of bounds index "     \
-        "%ld in the constants vector, but only have %ld constants.\n", \
-        a0, constants_length);                                         \
-    break;                                                             \
-  }                                                                    \
-  c0 = constants->values[a0];
+struct object *builtin_function_macro(struct object **args, ufixnum_t nargs) {
+  return (type_of(args[0]) == gis->function_type && FUNCTION_IS_MACRO(args[0])) ? T : NIL;
+}
 
-/* Gets the item in the data stack at the index i. (e.g. STACK_I(0) is the top
- * of the stack) */
-#define STACK_I(i)                      \
-  DYNAMIC_ARRAY_VALUES(gis->data_stack) \
-  [DYNAMIC_ARRAY_LENGTH(gis->data_stack) - 1 - (i)]
+struct object *builtin_find_package(struct object **args, ufixnum_t nargs) {
+  return find_package(string_designator(args[0]));
+}
 
-void prepare_function_call(unsigned long nargs, struct object *old_f, struct object *old_i, struct object *new_f) {
-  unsigned long argi;
-  struct object *args;
+struct object *builtin_symbol_type(struct object **args, ufixnum_t nargs) {
+  return symbol_get_type(args[0]);
+}
 
-  symbol_set_value(gis->impl_f_sym, new_f);
+struct object *builtin_type_of(struct object **args, ufixnum_t nargs) {
+  return type_of(args[0]);
+}
 
-  /* transfer arguments from data stack to call stack */
-  if (FUNCTION_ACCEPTS_ALL(new_f)) {
-    args = NIL;
-    for (argi = 0; argi < nargs; ++argi) {
-      args = cons(STACK_I(argi + 1), args);
-    }
-    dynamic_array_push(gis->call_stack, args);
-  } else {
-    if (nargs != FUNCTION_NARGS(new_f)) {
-      printf("Function was passed invalid number of arguments.\n");
-      print(new_f);
-      PRINT_STACK_TRACE_AND_QUIT();
-    }
-    for (argi = nargs; argi > 0; --argi) {
-      dynamic_array_push(gis->call_stack, STACK_I(argi));
-    }
-  }
+struct object *builtin_dynamic_byte_array_as_string(struct object **args, ufixnum_t nargs) {
+  OT2("dynamic-byte-array-as-string", 0, args[0], type_dynamic_byte_array, type_string);
+  OBJECT_TYPE(args[0]) = type_string;
+  return args[0];
+}
 
-  /* remove all arguments and the function from the data stack at once */
-  DYNAMIC_ARRAY_LENGTH(gis->data_stack) -= nargs + 1;
+struct object *builtin_dynamic_array(struct object **args, ufixnum_t nargs) {
+  OT("dynamic-array", 0, args[0], type_fixnum);
+  return dynamic_array(FIXNUM_VALUE(args[0]));
+}
 
-  /* initialize any temps with NIL -- could be improved by just adding to
-   * the call stack's length */
-  for (argi = 0; argi < FUNCTION_STACK_SIZE(new_f) - FUNCTION_NARGS(new_f); ++argi) {
-    dynamic_array_push(gis->call_stack, NIL);
-  }
+struct object *builtin_dynamic_byte_array(struct object **args, ufixnum_t nargs) {
+  OT("dynamic-byte-array", 0, args[0], type_fixnum);
+  return dynamic_byte_array(FIXNUM_VALUE(args[0]));
+}
 
-  /* save the instruction index, and function */
-  if (old_i == NIL) {
-    printf("Not supported\n");
-    PRINT_STACK_TRACE_AND_QUIT();
-  }
-  UFIXNUM_VALUE(old_i) += 1; /* resume at the next instruction */
-  dynamic_array_push(gis->call_stack, old_i);
-  dynamic_array_push(gis->call_stack, old_f);
+struct object *builtin_to_string(struct object **args, ufixnum_t nargs) {
+  return to_string(args[0]);
+}
 
-  symbol_set_value(gis->impl_i_sym,
-                   ufixnum(0)); /* start the bytecode interpreter at the first instruction */
+struct object *builtin_symbol_plist(struct object **args, ufixnum_t nargs) {
+  OT("symbol-plist", 0, args[0], type_symbol);
+  return SYMBOL_PLIST(args[0]);
 }
 
-struct object *call_function(struct object *f, struct object *args) {
+/* the value of key in the symbol's plist (NIL if it isn't there) */
+struct object *builtin_symbol_property(struct object **args, ufixnum_t nargs) {
   struct object *cursor;
-  ufixnum_t i, nargs;
+  OT("symbol-property", 0, args[0], type_symbol);
+  for (cursor = SYMBOL_PLIST(args[0]); cursor != NIL; cursor = CONS_CDR(CONS_CDR(cursor)))
+    if (CONS_CAR(cursor) == args[1]) return CONS_CAR(CONS_CDR(cursor));
+  return NIL;
+}
 
-  if (FUNCTION_ACCEPTS_ALL(f)) {
-    nargs = 1;
-    dynamic_array_push(gis->call_stack, args);
-  } else {
-    nargs = 0;
-    cursor = args;
-    while (cursor != NIL) {
-      dynamic_array_push(gis->call_stack, CONS_CAR(cursor));
-      cursor = CONS_CDR(cursor);
-      ++nargs;
-    }
-    if (nargs != FUNCTION_NARGS(f)) {
-      printf("Function was given %d, but takes %d.\n", (int)nargs, (int)FUNCTION_NARGS(f));
-      print(f);
-      PRINT_STACK_TRACE_AND_QUIT();
+struct object *builtin_set_symbol_property(struct object **args, ufixnum_t nargs) {
+  struct object *cursor;
+  OT("set-symbol-property", 0, args[0], type_symbol);
+  for (cursor = SYMBOL_PLIST(args[0]); cursor != NIL; cursor = CONS_CDR(CONS_CDR(cursor))) {
+    if (CONS_CAR(cursor) == args[1]) {
+      CONS_CAR(CONS_CDR(cursor)) = args[2];
+      return args[2];
     }
   }
+  SYMBOL_PLIST(args[0]) = cons(args[1], cons(args[2], SYMBOL_PLIST(args[0])));
+  return args[2];
+}
+
+/* records how to copy f, the function just given to name, from definition -- (name params body) -- as name's
+   inline property: (params body f) (see inline.bug). Returns f. */
+struct object *builtin_define_inline(struct object **args, ufixnum_t nargs) {
+  struct object *property[3];
+  OT("define-inline", 0, args[0], type_function);
+  OT("define-inline", 1, args[1], type_cons);
+  property[0] = CONS_CAR(args[1]);
+  property[1] = gis->lisp_inline_sym;
+  property[2] = cons(CONS_CAR(CONS_CDR(args[1])), cons(CONS_CAR(CONS_CDR(CONS_CDR(args[1]))), cons(args[0], NIL)));
+  builtin_set_symbol_property(property, 3);
+  return args[0];
+}
 
-  /* initialize any temps with NIL -- could be improved by just adding to
-   * the call stack's length */
-  for (i = 0; i < FUNCTION_STACK_SIZE(f) - FUNCTION_NARGS(f); ++i) {
-    dynamic_array_push(gis->call_stack, NIL);
+/* records that caller's function has the functions of the symbols in callees inlined, and that fallback
+   should take its place if any of them are defined again (see "Inlining") */
+struct object *builtin_record_inlining(struct object **args, ufixnum_t nargs) {
+  struct object *cursor, *callee, *dependents, *entry;
+  OT("record-inlining", 0, args[0], type_symbol);
+  OT_LIST("record-inlining", 1, args[1]);
+  OT("record-inlining", 2, args[2], type_function);
+  entry = cons(args[0], cons(SYMBOL_FUNCTION(args[0]), cons(args[2], NIL)));
+  for (cursor = args[1]; cursor != NIL; cursor = CONS_CDR(cursor)) {
+    callee = CONS_CAR(cursor);
+    OT("record-inlining", 1, callee, type_symbol);
+    /* (an older entry for the same caller is replaced) */
+    for (dependents = SYMBOL_DEPENDENTS(callee); dependents != NIL; dependents = CONS_CDR(dependents))
+      if (CONS_CAR(CONS_CAR(dependents)) == args[0]) break;
+    if (dependents == NIL)
+      SYMBOL_DEPENDENTS(callee) = cons(entry, SYMBOL_DEPENDENTS(callee));
+    else
+      CONS_CAR(dependents) = entry;
   }
+  return NIL;
+}
 
-  /* save the instruction index, and function */
-  /* if there is anything to return to --
-     if this is a macro that is being called from the top level, there would be nothing to return to. */
-  if (symbol_get_value(gis->impl_f_sym) != NIL) {
-    /* resume at the next instruction */
-    if (symbol_get_value(gis->impl_i_sym) != NIL) { /* impl_i_sym's value can be null if a builtin was just called */
-      UFIXNUM_VALUE(symbol_get_value(gis->impl_i_sym)) += 1;
-      dynamic_array_push(gis->call_stack, symbol_get_value(gis->impl_i_sym));
-    } else {
-      dynamic_array_push(gis->call_stack, NIL);
-    }
-    dynamic_array_push(gis->call_stack, symbol_get_value(gis->impl_f_sym));
-  } else {
-    /* there is no where to return to, but because we put the function/instruction-index at the top
-       of the stack, we need to fill it with something (because GET_LOCAL(...) depends on that) */
-    dynamic_array_push(gis->call_stack, NIL);
-    dynamic_array_push(gis->call_stack, NIL);
+struct object *builtin_symbol_value_set(struct object **args, ufixnum_t nargs) {
+  OT("symbol-value?", 0, args[0], type_symbol);
+  return SYMBOL_VALUE_IS_SET(args[0]) ? T : NIL;
+}
+
+struct object *builtin_dynamic_array_get(struct object **args, ufixnum_t nargs) {
+  return dynamic_array_get(args[0], args[1]);
+}
+
+struct object *builtin_dynamic_array_set(struct object **args, ufixnum_t nargs) {
+  dynamic_array_set(args[0], args[1], args[2]);
+  return NIL;
+}
+
+struct object *builtin_dynamic_array_length(struct object **args, ufixnum_t nargs) {
+  return dynamic_array_length(args[0]);
+}
+
+struct object *builtin_write_image(struct object **args, ufixnum_t nargs) {
+  write_image(args[0]);
+  return NIL;
+}
+
+struct object *builtin_dynamic_array_push(struct object **args, ufixnum_t nargs) {
+  dynamic_array_push(args[0], args[1]);
+  return NIL;
+}
+
+struct object *builtin_dynamic_array_pop(struct object **args, ufixnum_t nargs) {
+  return dynamic_array_pop(args[0]);
+}
+
+struct object *builtin_dynamic_array_concat(struct object **args, ufixnum_t nargs) {
+  return dynamic_array_concat(args[0], args[1]);
+}
+
+struct object *builtin_dynamic_byte_array_concat(struct object **args, ufixnum_t nargs) {
+  return dynamic_byte_array_concat(args[0], args[1]);
+}
+
+struct object *builtin_dynamic_byte_array_get(struct object **args, ufixnum_t nargs) {
+  OT("dynamic-byte-array-get", 1, args[1], type_fixnum);
+  return fixnum(dynamic_byte_array_get(args[0], FIXNUM_VALUE(args[1])));
+}
+
+struct object *builtin_dynamic_byte_array_insert(struct object **args, ufixnum_t nargs) {
+  OT("dynamic-byte-array-insert", 1, args[1], type_fixnum);
+  OT("dynamic-byte-array-insert", 2, args[2], type_fixnum);
+  dynamic_byte_array_insert_char(args[0], FIXNUM_VALUE(args[1]), FIXNUM_VALUE(args[2]));
+  return NIL;
+}
+
+struct object *builtin_dynamic_byte_array_length(struct object **args, ufixnum_t nargs) {
+  return dynamic_byte_array_length(args[0]);
+}
+
+struct object *builtin_dynamic_byte_array_set(struct object **args, ufixnum_t nargs) {
+  OT("dynamic-byte-array-set", 1, args[1], type_fixnum);
+  OT("dynamic-byte-array-set", 2, args[2], type_fixnum);
+  dynamic_byte_array_set(args[0], FIXNUM_VALUE(args[1]), FIXNUM_VALUE(args[2]));
+  return NIL;
+}
+
+struct object *builtin_dynamic_byte_array_push(struct object **args, ufixnum_t nargs) {
+  return dynamic_byte_array_push(args[0], args[1]);
+}
+
+struct object *builtin_dynamic_byte_array_pop(struct object **args, ufixnum_t nargs) {
+  return dynamic_byte_array_pop(args[0]);
+}
+
+struct object *builtin_define_struct(struct object **args, ufixnum_t nargs) {
+  return type(args[0], args[1], 1, 0);
+}
+
+struct object *builtin_change_directory(struct object **args, ufixnum_t nargs) {
+  change_directory(args[0]);
+  return NIL;
+}
+
+struct object *builtin_get_current_working_directory(struct object **args, ufixnum_t nargs) {
+  return get_current_working_directory();
+}
+
+struct object *builtin_alloc_struct(struct object **args, ufixnum_t nargs) {
+  return alloc_struct(args[0], 1);
+}
+
+struct object *builtin_gensym(struct object **args, ufixnum_t nargs) {
+  struct object *t0;
+  t0 = symbol(string_concat(string("gensym-"), to_string(ufixnum(gis->gensym_counter))));
+  ++gis->gensym_counter;
+  return t0;
+}
+
+struct object *builtin_function_code(struct object **args, ufixnum_t nargs) {
+  OT("function-code", 0, args[0], type_function);
+  /* (if the code is changed, the function is decoded again the next time it is called -- see redecode_function) */
+  return FUNCTION_CODE(args[0]);
+}
+
+struct object *builtin_apply(struct object **args, ufixnum_t nargs) {
+  struct object *t0, *t1;
+  OT_LIST("apply", 1, args[1]);
+  t0 = args[0];
+  if (type_of(t0) == gis->symbol_type) {
+    t0 = symbol_get_function(t0);
   }
+  if (type_of(t0) != gis->function_type) {
+    printf("Apply must be given a function or symbol that has a function.\n");
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  t1 = args[1]; /* we must read the argument now -- call_function pushes to the data stack (which can move args) */
+  gis->vm.f = NIL; /* call as if from the top level, so the nested run returns here */
+  t0 = call_function(t0, t1);
+  gis->vm.f = gis->apply_builtin; /* we must restore this before returning so that op_return knows we are returning from apply */
+  /* (render-html `(div ((a 3) (b 1)) (span) (span "hello")))
+    There is a big call-stack leak and a small data-stack leak. why?!
+    it seems to only happen when  a string is passed 
+  */
+  return t0;
+}
 
-  /* start the bytecode interpreter at the first instruction */
-  symbol_set_value(gis->impl_i_sym, ufixnum(0));
-  symbol_set_value(gis->impl_f_sym, f);
-  run(gis);
-  return pop(); /* discard the result so it doesn't leak into the data-stack */
+struct object *builtin_struct_field(struct object **args, ufixnum_t nargs) {
+  return struct_field(args[0], args[1]);
 }
 
-/* returns the top of the stack for convience */
-  /* evaluates gis->function starting at instruction gis->i */
-  /* assumes gis->i and gis->f is set and call_stack has been initialized with
-   * space for all stack args */
-  struct object *run(struct gis * gis) {
-    unsigned long byte_count,
-        op_arg_byte_count; /* number of  bytes in this bytecode */
-    unsigned char t0, op;  /* temporary for reading bytecode arguments */
-    unsigned long a0, a1;  /* the arguments for bytecode parameters */
-    unsigned long a2;
-    unsigned long sa0;               /* argument for jumps */
-    struct object *v0, *v1; /* temps for values popped off the stack */
-    struct object *c0; /* temps for constants (used for bytecode arguments) */
-    struct object *temp_i, *temp_f, *f;
-    struct object *cursor;
-    struct dynamic_byte_array
-        *code; /* the byte array containing the bytes in the bytecode */
-    struct dynamic_array *constants; /* the constants array */
-    unsigned long constants_length;  /* the length of the constants array */
-    struct object *i;
-    ufixnum_t ufix0;
-    void *arg_values[MAX_FFI_NARGS]; /* for calling foreign functions */
-    ffi_sarg sresult;                /* signed result */
-    void *ptr_result;
-    /* jump to this label after setting a new gis->i and gis->f
-       (and pushing the old i and bc to the call-stack) */
+struct object *builtin_set_struct_field(struct object **args, ufixnum_t nargs) {
+  set_struct_field(args[0], args[1], args[2]);
+  return NIL;
+}
 
-  eval_restart:
-    f = symbol_get_value(gis->impl_f_sym);
-    code = FUNCTION_CODE(f)->w1.value.dynamic_byte_array;
-    constants = FUNCTION_CONSTANTS(f)->w1.value.dynamic_array;
-    constants_length = constants->length;
-    byte_count = code->length;
-    i = symbol_get_value(gis->impl_i_sym);
+struct object *builtin_symbol_name(struct object **args, ufixnum_t nargs) {
+  OT("symbol-name", 0, args[0], type_symbol);
+  return SYMBOL_NAME(args[0]);
+}
 
-    while (UFIXNUM_VALUE(i) < byte_count) {
-      op = code->bytes[UFIXNUM_VALUE(i)];
-      switch (op) {
-        case op_drop: /* drop ( x -- ) */
-          SC("drop", 1);
-          pop();
-          break;
-        case op_dup: /* dup ( x -- x x ) */
-          SC("dup", 1);
-          dup();
-          break;
-        case op_cons: /* cons ( car cdr -- (cons car cdr) ) */
-          SC("cons", 2);
-          v1 = pop(); /* cdr */
-          v0 = STACK_I(0); /* car */
-          STACK_I(0) = cons(v0, v1);
-          break;
-        case op_intern: /* intern ( string -- symbol ) */
-          SC("intern", 1);
-          v0 = STACK_I(0);
-          printf("op_intern is not implemented.");
-          PRINT_STACK_TRACE_AND_QUIT();
-          OT("intern", 0, v0, type_string);
-          STACK_I(0) = intern(pop(), NIL);
-          break;
-        case op_car: /* car ( (cons car cdr) -- car ) */
-          SC("car", 1);
-          v0 = STACK_I(0);
-          if (v0 == NIL) {
-            STACK_I(0) = NIL;
-          } else if (type_of(v0) == gis->cons_type) {
-            STACK_I(0) = CONS_CAR(v0);
-          } else {
-            printf("Can only car a list (was given a %s).\n",
-                   type_name_of_cstr(v0));
-            PRINT_STACK_TRACE_AND_QUIT();
-          }
-          break;
-        case op_cdr: /* cdr ( (cons car cdr) -- cdr ) */
-          SC("cdr", 1);
-          v0 = STACK_I(0);
-          if (v0 == NIL) {
-            STACK_I(0) = NIL;
-          } else if (type_of(v0) == gis->cons_type) {
-            STACK_I(0) = CONS_CDR(v0);
-          } else {
-            printf("Can only cdr a list (was given a %s).\n",
-                   type_name_of_cstr(v0));
-            PRINT_STACK_TRACE_AND_QUIT();
-          }
-          break;
-        case op_gt: /* gt ( x y -- x>y ) */
-          SC("gt", 2);
-          v1 = pop(); /* y */
-          STACK_I(0) = FIXNUM_VALUE(STACK_I(0)) > FIXNUM_VALUE(v1)
-                           ? T
-                           : NIL; /* TODO: support flonum/ufixnum */
-          break;
-        case op_lt: /* lt ( x y -- x<y ) */
-          SC("lt", 2);
-          v1 = pop(); /* y */
-          STACK_I(0) = FIXNUM_VALUE(STACK_I(0)) < FIXNUM_VALUE(v1)
-                           ? T
-                           : NIL; /* TODO: support flonum/ufixnum */
-          break;
-        case op_lti: /* lti <n> ( x -- x<n ) */
-          SC("lti", 1);
-          READ_OP_ARG();
-          STACK_I(0) = FIXNUM_VALUE(STACK_I(0)) < a0
-                           ? T
-                           : NIL; /* TODO: support flonum/ufixnum */
-          break;
-        case op_gte: /* gte ( x y -- x>=y ) */
-          SC("gte", 2);
-          v1 = pop(); /* y */
-          STACK_I(0) = FIXNUM_VALUE(STACK_I(0)) >= FIXNUM_VALUE(v1)
-                           ? T
-                           : NIL; /* TODO: support flonum/ufixnum */
-          break;
-        case op_lte: /* gte ( x y -- x<=y ) */
-          SC("lte", 2);
-          v1 = pop(); /* y */
-          STACK_I(0) = FIXNUM_VALUE(STACK_I(0)) <= FIXNUM_VALUE(v1)
-                           ? T
-                           : NIL; /* TODO: support flonum/ufixnum */
-          break;
-        case op_bin_or:
-          SC("bin_or", 2);
-          v1 = pop(); /* y */
-          STACK_I(0) =
-              fixnum(FIXNUM_VALUE(STACK_I(0)) | FIXNUM_VALUE(v1)); /* TODO: support flonum/ufixnum */
-          break;
-        case op_bin_and:
-          SC("bin_and", 2);
-          v1 = pop(); /* y */
-          STACK_I(0) =
-              fixnum(FIXNUM_VALUE(STACK_I(0)) & FIXNUM_VALUE(v1)); /* TODO: support flonum/ufixnum */
-          break;
-        case op_shift_right:
-          SC("shift-right", 2);
-          v1 = pop(); /* y */
-          STACK_I(0) =
-              fixnum(FIXNUM_VALUE(STACK_I(0)) >> FIXNUM_VALUE(v1)); /* TODO: support flonum/ufixnum */
-          break;
-        case op_shift_left:
-          SC("shift-left", 2);
-          v1 = pop(); /* y */
-          STACK_I(0) =
-              fixnum(FIXNUM_VALUE(STACK_I(0)) << FIXNUM_VALUE(v1)); /* TODO: support flonum/ufixnum */
-          break;
-        case op_add: /* add ( x y -- x+y ) */
-          SC("add", 2);
-          v1 = pop(); /* y */
-          STACK_I(0) =
-              fixnum(FIXNUM_VALUE(STACK_I(0)) +
-                     FIXNUM_VALUE(v1)); /* TODO: support flonum/ufixnum */
-          break;
-        case op_addi: /* add-i <n> ( x -- x+n ) */
-          READ_OP_ARG();
-          STACK_I(0) = fixnum(FIXNUM_VALUE(STACK_I(0)) + a0);
-          break;
-        case op_subi: /* add-i <n> ( x -- ) */
-          READ_OP_ARG();
-          STACK_I(0) = fixnum(FIXNUM_VALUE(STACK_I(0)) - a0);
-          break;
-        case op_sub: /* sub ( x y -- x-y ) */
-          SC("sub", 2);
-          v1 = pop(); /* y */
-          STACK_I(0) =
-              fixnum(FIXNUM_VALUE(STACK_I(0)) -
-                     FIXNUM_VALUE(v1)); /* TODO: support flonum/ufixnum */
-          break;
-        case op_mul: /* mul ( x y -- x*y ) */
-          SC("mul", 2);
-          v1 = pop(); /* y */
-          STACK_I(0) =
-              fixnum(FIXNUM_VALUE(STACK_I(0)) *
-                     FIXNUM_VALUE(v1)); /* TODO: support flonum/ufixnum */
-          break;
-        case op_div: /* div ( x y -- x/y ) */
-          SC("div", 2);
-          v1 = pop(); /* y */
-          STACK_I(0) =
-              fixnum(FIXNUM_VALUE(STACK_I(0)) /
-                     FIXNUM_VALUE(v1)); /* TODO: support flonum/ufixnum */
-          break;
-        case op_eq: /* eq ( x y -- z ) */
-          SC("eq", 2);
-          v1 = pop(); /* y */
-          /* TODO: add t */
-          STACK_I(0) = equals(STACK_I(0), v1) ? gis->type_t_sym : NIL;
-          break;
-        case op_and: /* and ( x y -- z ) */
-          SC("and", 2);
-          v1 = pop(); /* y */
-          if (STACK_I(0) != NIL && v1 != NIL)
-            STACK_I(0) = v1;
-          else
-            STACK_I(0) = NIL;
-          break;
-        case op_list: /* list <n> ( ...n... -- ) */
-          READ_OP_ARG();
-          if (a0 == 0)
-            push(NIL);
-          else if (a0 == 1)
-            STACK_I(0) = cons(STACK_I(0), NIL);
-          else {
-            STACK_I(0) = cons(STACK_I(0), NIL);
-            for (a1 = 1; a1 < a0; ++a1)
-              STACK_I(0) = cons(STACK_I(a1), STACK_I(0));
-            /* set the earliest stack item to be the result, because so we can
+struct object *builtin_dynamic_library(struct object **args, ufixnum_t nargs) {
+  return dlib(args[0]);
+}
+
+struct object *builtin_byte_stream(struct object **args, ufixnum_t nargs) {
+  return byte_stream_lift(args[0]);
+}
+
+struct object *builtin_byte_stream_peek(struct object **args, ufixnum_t nargs) {
+  return byte_stream_peek(args[0], FIXNUM_VALUE(args[1])); /* TODO: support more than just fixnum */
+}
+
+struct object *builtin_byte_stream_peek_byte(struct object **args, ufixnum_t nargs) {
+  return fixnum(byte_stream_peek_byte(args[0]));
+}
+
+struct object *builtin_byte_stream_has(struct object **args, ufixnum_t nargs) {
+  return byte_stream_has(args[0]) ? T : NIL;
+}
+
+struct object *builtin_byte_stream_read(struct object **args, ufixnum_t nargs) {
+  return byte_stream_read(args[0], FIXNUM_VALUE(args[1])); /* TODO: support more than just fixnum */
+}
+
+struct object *builtin_close_file(struct object **args, ufixnum_t nargs) {
+  close_file(args[0]);
+  return NIL;
+}
+
+struct object *builtin_open_file(struct object **args, ufixnum_t nargs) {
+  return open_file(args[0], args[1]);
+}
+
+struct object *builtin_read_bytecode_file(struct object **args, ufixnum_t nargs) {
+  return read_bytecode_file(args[0]);
+}
+
+struct object *builtin_read_file(struct object **args, ufixnum_t nargs) {
+  return read_file(args[0]);
+}
+
+struct object *builtin_marshal(struct object **args, ufixnum_t nargs) {
+  return marshal(args[0], args[1], NULL);
+}
+
+struct object *builtin_marshal_integer(struct object **args, ufixnum_t nargs) {
+  return marshal_ufixnum(args[0], args[1], args[2] == NIL ? 0 : 1);
+}
+
+struct object *builtin_unmarshal(struct object **args, ufixnum_t nargs) {
+  return unmarshal(args[0], NULL);
+}
+
+struct object *builtin_write_bytecode_file(struct object **args, ufixnum_t nargs) {
+  write_bytecode_file(args[0], args[1]);
+  return NIL;
+}
+
+struct object *builtin_write_file(struct object **args, ufixnum_t nargs) {
+  write_file(args[0], args[1]);
+  return NIL;
+}
+
+struct object *builtin_string_concat(struct object **args, ufixnum_t nargs) {
+  return string_concat_external(args[0], args[1]);
+}
+
+struct object *builtin_foreign_function(struct object **args, ufixnum_t nargs) {
+  return foreign_function(args[0], args[1], args[2], args[3]);
+}
+
+struct object *builtin_package_symbols(struct object **args, ufixnum_t nargs) {
+  OT("package-symbols", 0, args[0], type_package);
+  return PACKAGE_SYMBOLS(args[0]);
+}
+
+struct object *builtin_intern(struct object **args, ufixnum_t nargs) {
+  OT("intern", 0, args[0], type_string);
+  OT("intern", 1, args[1], type_package);
+  return intern(args[0], args[1]);
+}
+
+struct object *builtin_make_symbol(struct object **args, ufixnum_t nargs) {
+  OT("make-symbol", 0, args[0], type_string);
+  return symbol(args[0]);
+}
+
+struct object *builtin_package_name(struct object **args, ufixnum_t nargs) {
+  OT("package-name", 0, args[0], type_package);
+  return PACKAGE_NAME(args[0]);
+}
+
+struct object *builtin_make_function(struct object **args, ufixnum_t nargs) {
+  struct object *t0;
+  OT("make-function", 0, args[0], type_symbol); /* name */
+  OT2("make-function", 1, args[1], type_string, type_symbol); /* docstring - string or nil*/
+  OT("make-function", 2, args[2], type_fixnum); /* stack size */
+  OT("make-function", 3, args[3], type_fixnum); /* nargs */
+  /* local 4 - parameters: nil, t (the function takes all of its arguments as a list) or a fixnum (see function_parameters) */
+  /* local 5 - is macro */
+  OT("make-function", 6, args[6], type_dynamic_byte_array); /* code */
+  OT("make-function", 7, args[7], type_dynamic_array); /* constants */
+
+  t0 = function(args[7], args[6], FIXNUM_VALUE(args[2]));
+  FUNCTION_NAME(t0) = args[0];
+  FUNCTION_DOCSTRING(t0) = args[1];
+  set_function_parameters(t0, FIXNUM_VALUE(args[3]),
+                          args[4] == NIL ? 0 : type_of(args[4]) == gis->fixnum_type ? FIXNUM_VALUE(args[4]) : 1);
+  FUNCTION_IS_MACRO(t0) = args[5] == NIL ? 0 : 1;
+  return t0;
+}
+
+struct object *builtin_find_symbol(struct object **args, ufixnum_t nargs) {
+  OT("find-symbol", 0, args[0], type_string);
+  OT("find-symbol", 0, args[1], type_package);
+  return find_symbol(args[0], args[1], 1);
+}
+
+struct object *builtin_make_package(struct object **args, ufixnum_t nargs) {
+  struct object *t0, *t1;
+  OT("make-package", 0, args[0], type_string);
+  /* arg 1 is not used - reserved for implementing package nicknames later */
+  OT_LIST("make-package", 2, args[2]); /* use package list */
+  /* TODO check for naming conflicts */
+  t0 = package(args[0]);
+  t1 = args[2];
+  while (t1 != NIL) {
+    use_package(t0, CONS_CAR(t1));
+    t1 = CONS_CDR(t1);
+  }
+  return t0;
+}
+
+/** evaluates a builtin function (its arguments are the locals of the current frame) */
+void eval_builtin(struct object *f) {
+  builtin_fn fn;
+  fn = builtins[FUNCTION_BUILTIN_INDEX(f)];
+  if (fn == NULL) {
+    printf("Unknown builtin\n");
+    print(f);
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  gis->vm.nvalues = 1; /* (before the call -- apply returns the values of the function it calls) */
+  push(fn(&DYNAMIC_ARRAY_VALUES(gis->data_stack)[gis->vm.fp], FUNCTION_NARGS(f)));
+}
+
+#define GIS_BUILTIN(name, sym, nargs) \
+  gis->name##_builtin = register_builtin(sym, nargs, builtin_##name);
+
+#define GIS_BUILTIN_S(name, package, symbol_name, nargs)                  \
+  GIS_BUILTIN(name, symbol(string(symbol_name)), nargs);                  \
+  SYMBOL_PACKAGE(FUNCTION_NAME(gis->name##_builtin)) = package;           \
+  PACKAGE_SYMBOLS(package) =                                              \
+      cons(FUNCTION_NAME(gis->name##_builtin), PACKAGE_SYMBOLS(package)); \
+  symbol_export(FUNCTION_NAME(gis->name##_builtin));
+
+/* creates all builtin functions (called by gis_init) */
+void init_builtins() {
+  builtins_length = 0;
+  GIS_BUILTIN(alloc_struct, gis->impl_alloc_struct_sym, 1);
+  GIS_BUILTIN(apply, gis->lisp_apply_sym, 2);
+  GIS_BUILTIN(byte_stream, gis->impl_byte_stream_sym, 1);
+  GIS_BUILTIN(byte_stream_peek, gis->impl_byte_stream_peek_sym, 2);
+  GIS_BUILTIN(byte_stream_peek_byte, gis->impl_byte_stream_peek_byte_sym, 1);
+  GIS_BUILTIN(byte_stream_read, gis->impl_byte_stream_read_sym, 2);
+  GIS_BUILTIN(byte_stream_has, gis->impl_byte_stream_has_sym, 1);
+  gis->debugger_builtin = register_builtin(gis->impl_debugger_sym, 0, NULL); /* not implemented yet */
+  GIS_BUILTIN(dynamic_byte_array_as_string, gis->impl_dynamic_byte_array_as_string_sym, 1);
+  GIS_BUILTIN(dynamic_array, gis->type_dynamic_array_sym, 1);
+  GIS_BUILTIN_S(dynamic_array_get, gis->impl_package, "dynamic-array-get", 2);
+  PACKAGE_SYMBOLS(gis->lisp_package) = cons(FUNCTION_NAME(gis->dynamic_array_get_builtin), PACKAGE_SYMBOLS(gis->lisp_package));
+  GIS_BUILTIN(dynamic_array_set, gis->lisp_dynamic_array_set_sym, 3);
+  GIS_BUILTIN(dynamic_array_length, gis->lisp_dynamic_array_length_sym, 1);
+  GIS_BUILTIN(dynamic_array_push, gis->lisp_dynamic_array_push_sym, 2);
+  GIS_BUILTIN(dynamic_array_pop, gis->lisp_dynamic_array_pop_sym, 1);
+  GIS_BUILTIN(dynamic_array_concat, gis->lisp_dynamic_array_concat_sym, 2);
+  GIS_BUILTIN(dynamic_byte_array, gis->type_dynamic_byte_array_sym, 1);
+  GIS_BUILTIN(dynamic_byte_array_concat, gis->impl_dynamic_byte_array_concat_sym, 2);
+  GIS_BUILTIN(dynamic_byte_array_get, gis->impl_dynamic_byte_array_get_sym, 2);
+  GIS_BUILTIN(dynamic_byte_array_insert, gis->impl_dynamic_byte_array_insert_sym, 3);
+  GIS_BUILTIN(dynamic_byte_array_length, gis->impl_dynamic_byte_array_length_sym, 1);
+  GIS_BUILTIN(dynamic_byte_array_set, gis->impl_dynamic_byte_array_set_sym, 3);
+  GIS_BUILTIN(dynamic_byte_array_push, gis->impl_dynamic_byte_array_push_sym, 2);
+  GIS_BUILTIN(dynamic_byte_array_pop, gis->impl_dynamic_byte_array_pop_sym, 1);
+  GIS_BUILTIN(change_directory, gis->impl_change_directory_sym, 1) /* takes the new directory */
+  GIS_BUILTIN(close_file, gis->impl_close_file_sym, 1);
+  GIS_BUILTIN(dynamic_library, gis->type_dynamic_library_sym, 1)  /* takes the path */
+  GIS_BUILTIN(get_current_working_directory, gis->impl_get_current_working_directory_sym, 0)
+  GIS_BUILTIN(gensym, gis->lisp_gensym_sym, 0)
+  GIS_BUILTIN(fbound, gis->lisp_fbound_sym, 1);
+  GIS_BUILTIN(function_macro, gis->lisp_function_macro_sym, 1);
+  GIS_BUILTIN(find_package, gis->lisp_find_package_sym, 1);
+  GIS_BUILTIN(find_symbol, gis->lisp_find_symbol_sym, 2);
+  GIS_BUILTIN(foreign_function, gis->type_foreign_function_sym, 4) /* takes the dlib, the name, and the parameter types */
+  GIS_BUILTIN(function_code, gis->impl_function_code_sym, 1)
+  GIS_BUILTIN(intern, gis->lisp_intern_sym, 2);
+  GIS_BUILTIN(make_function, gis->impl_make_function_sym, 8);
+  GIS_BUILTIN(make_symbol, gis->lisp_make_symbol_sym, 1);
+  GIS_BUILTIN(make_package, gis->lisp_make_package_sym, 3);
+  GIS_BUILTIN(marshal, gis->impl_marshal_sym, 2);
+  GIS_BUILTIN(marshal_integer, gis->impl_marshal_integer_sym, 3);
+  GIS_BUILTIN(open_file, gis->impl_open_file_sym, 2);
+  GIS_BUILTIN(package_symbols, gis->lisp_package_symbols_sym, 1);
+  GIS_BUILTIN(package_name, gis->lisp_package_name_sym, 1);
+  GIS_BUILTIN(type_of, gis->impl_type_of_sym, 1)
+  GIS_BUILTIN(read_bytecode_file, gis->impl_read_bytecode_file_sym, 1);
+  GIS_BUILTIN(read_file, gis->impl_read_file_sym, 1);
+  GIS_BUILTIN(define_inline, gis->impl_define_inline_sym, 2);
+  GIS_BUILTIN(record_inlining, gis->impl_record_inlining_sym, 3);
+  GIS_BUILTIN(define_struct, gis->impl_define_struct_sym, 2);
+  GIS_BUILTIN(symbol_name, gis->lisp_symbol_name_sym, 1);
+  GIS_BUILTIN(symbol_plist, gis->lisp_symbol_plist_sym, 1);
+  GIS_BUILTIN(symbol_property, gis->lisp_symbol_property_sym, 2);
+  GIS_BUILTIN(symbol_type, gis->impl_symbol_type_sym, 1);
+  GIS_BUILTIN(symbol_value_set, gis->lisp_symbol_value_set_sym, 1);
+  GIS_BUILTIN(string_concat, gis->impl_string_concat_sym, 2);
+  GIS_BUILTIN(struct_field, gis->impl_struct_field_sym, 2);
+  GIS_BUILTIN(set_struct_field, gis->impl_set_struct_field_sym, 3);
+  GIS_BUILTIN(set_symbol_property, gis->impl_set_symbol_property_sym, 3);
+  GIS_BUILTIN(to_string, gis->lisp_to_string_sym, 1);
+  GIS_BUILTIN(unmarshal, gis->impl_unmarshal_sym, 1);
+  GIS_BUILTIN(use_package, gis->impl_use_package_sym, 1) /* takes name of package */
+  GIS_BUILTIN(write_bytecode_file, gis->impl_write_bytecode_file_sym, 2);
+  GIS_BUILTIN(write_file, gis->impl_write_file_sym, 2);
+  GIS_BUILTIN(write_image, gis->impl_write_image_sym, 1);
+}
+
+/* Dispatch
+ * By default ops are dispatched with the switch in run. When THREADED_DISPATCH is defined (the
+ * BUG_THREADED_DISPATCH cmake option -- GCC/Clang only) each op instead jumps directly to the next op's
+ * label through dispatch_table (labels as values). Each op gets its own indirect jump, which the CPU
+ * predicts much better than the switch's single shared one (see research/interpreters/threaded-code.html).
+ * The switch is still there in threaded mode, so a plain "break" in an op is still correct (just slower).
+ *
+ * TARGET(op) -- the start of an op
+ * NEXT()     -- go to the next instruction
+ * DISPATCH() -- go to the instruction at i (for ops that set i themselves like jumps)
+ */
+#ifdef THREADED_DISPATCH
+#define TARGET(op) case op: label_##op
+#define TARGET_DEFAULT default: label_default
+#define SET_TARGET(op) dispatch_table[op] = &&label_##op
+#define DISPATCH()                     \
+  {                                    \
+    if (i >= instruction_count) goto end_of_code; \
+    word = instructions[i];            \
+    op = INSTRUCTION_OP(word);         \
+    PROFILE_OP();                      \
+    goto *dispatch_table[op];          \
+  }
+#define NEXT() \
+  {            \
+    ++i;       \
+    DISPATCH() \
+  }
+#else
+#define TARGET(op) case op
+#define TARGET_DEFAULT default
+#define DISPATCH() continue
+#define NEXT() break
+#endif
+
+/* Exit reports
+ * Profiles (see "Op profile" and "Register form") are written to a file when bug exits. The REPL never
+ * returns, so they are also written when bug is stopped (or its output is closed).
+ */
+#if defined(OP_PROFILE) || defined(REGISTERS)
+#include <signal.h>
+
+#define MAX_EXIT_REPORTS 2
+
+static void (*exit_reports[MAX_EXIT_REPORTS])();
+static int exit_reports_length;
+static char exit_reports_written;
+
+void write_exit_reports() {
+  int k;
+  if (exit_reports_written) return;
+  exit_reports_written = 1;
+  for (k = 0; k < exit_reports_length; ++k) exit_reports[k]();
+}
+
+void exit_report_signal(int sig) {
+  write_exit_reports();
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+void add_exit_report(void (*report)()) {
+  if (exit_reports_length == 0) {
+    atexit(write_exit_reports);
+    signal(SIGINT, exit_report_signal);
+    signal(SIGTERM, exit_report_signal);
+#ifdef SIGPIPE
+    signal(SIGPIPE, exit_report_signal);
+#endif
+  }
+  exit_reports[exit_reports_length++] = report;
+}
+#endif
+
+/* Op profile
+ * When OP_PROFILE is defined (the BUG_OP_PROFILE cmake option) run counts how many times each pair and
+ * triple of ops is run one after the other -- in the same function without jumping in between -- and the
+ * counts are written to the file named by the BUG_OP_PROFILE environment variable (op-profile.txt if it
+ * isn't set) when bug exits. The superinstructions (see fuse_superinstructions) were chosen from these
+ * counts; bench/op-profile.sh runs the benchmarks with a profiling build and lists the most common
+ * sequences. Superinstructions (and register blocks) are turned off in this mode, so the pairs they would
+ * replace are counted -- but ops are quickened as usual, so the arithmetic and comparisons are counted as
+ * the quickened ops other builds run.
+ */
+#ifdef OP_PROFILE
+#define OP_PROFILE_OPS (op_registers + 1) /* every op */
+#define PROFILE_OP() op_profile_record(f, i, op)
+
+static unsigned long op_profile_pairs[OP_PROFILE_OPS][OP_PROFILE_OPS];
+static unsigned long op_profile_triples[OP_PROFILE_OPS][OP_PROFILE_OPS][OP_PROFILE_OPS];
+static struct object *op_profile_f; /* where the last op was run */
+static ufixnum_t op_profile_i;
+static int op_profile_ops[2] = {-1, -1}; /* the last two ops that were run in order (-1 if there wasn't one) */
+
+void op_profile_record(struct object *f, ufixnum_t i, unsigned char op) {
+  if (op >= OP_PROFILE_OPS) return;
+  if (f != op_profile_f || i != op_profile_i + 1) op_profile_ops[0] = op_profile_ops[1] = -1;
+  if (op_profile_ops[1] >= 0) {
+    ++op_profile_pairs[op_profile_ops[1]][op];
+    if (op_profile_ops[0] >= 0) ++op_profile_triples[op_profile_ops[0]][op_profile_ops[1]][op];
+  }
+  op_profile_ops[0] = op_profile_ops[1];
+  op_profile_ops[1] = op;
+  op_profile_f = f;
+  op_profile_i = i;
+}
+
+/* writes one line per sequence that was run: its length, how many times it was run, then its ops */
+void op_profile_write() {
+  FILE *file;
+  char *path;
+  int a, b, c;
+
+  path = getenv("BUG_OP_PROFILE");
+  file = fopen(path == NULL ? "op-profile.txt" : path, "w");
+  if (file == NULL) {
+    printf("Failed to open the op profile file.\n");
+    return;
+  }
+  for (a = 0; a < OP_PROFILE_OPS; ++a)
+    for (b = 0; b < OP_PROFILE_OPS; ++b) {
+      if (op_profile_pairs[a][b] == 0) continue;
+      fprintf(file, "2 %lu %d %d\n", op_profile_pairs[a][b], a, b);
+      for (c = 0; c < OP_PROFILE_OPS; ++c)
+        if (op_profile_triples[a][b][c] > 0)
+          fprintf(file, "3 %lu %d %d %d\n", op_profile_triples[a][b][c], a, b, c);
+    }
+  fclose(file);
+}
+
+void op_profile_init() {
+  add_exit_report(op_profile_write);
+}
+#else
+#define PROFILE_OP()
+#endif
+
+/* Quickening
+ * The generic arithmetic and comparison ops rewrite their own instruction (in the function's decoded
+ * instructions -- never its bytecode) to a version for the operand types they were given, if there is
+ * one. The quickened op checks that its operands still have those types, and if they don't it turns the
+ * instruction back into the generic op with an argument of 1, which means don't quicken it again.
+ */
+#define QUICKEN(fixnum_op, flonum_op, x, y)                        \
+  if (INSTRUCTION_ARG(word) == 0) {                                \
+    if (IS_IMMEDIATE_FIXNUM(x) && IS_IMMEDIATE_FIXNUM(y))          \
+      instructions[i] = INSTRUCTION(fixnum_op, 0);                 \
+    else if (IS_FLONUM(x) && IS_FLONUM(y))                         \
+      instructions[i] = INSTRUCTION(flonum_op, 0);                 \
+  }
+
+#define DEQUICKEN(generic_op)                    \
+  {                                              \
+    instructions[i] = INSTRUCTION(generic_op, 1); \
+    DISPATCH();                                  \
+  }
+
+#define BOTH_FIXNUMS(x, y) (IS_IMMEDIATE_FIXNUM(x) && IS_IMMEDIATE_FIXNUM(y))
+#define BOTH_FLONUMS(x, y) (IS_FLONUM(x) && IS_FLONUM(y))
+
+/* the bitwise ops only work on fixnums (a flonum has no bits to give them) -- this reports anything else */
+#define CHECK_FIXNUMS(name, x, y)        \
+  if (!BOTH_FIXNUMS(x, y)) {             \
+    OT(name, 0, x, type_fixnum);         \
+    OT(name, 1, y, type_fixnum);         \
+  }
+
+/* how an op's argument is stored in the code */
+enum op_arg_kind {
+  op_arg_none,
+  op_arg_varint, /* one or more bytes, 7 bits per byte (least significant first) -- the msb says if there is another byte */
+  op_arg_jump /* two bytes (big endian) -- an offset from the last byte of the jump */
+};
+
+enum op_arg_kind op_arg_kind_of(unsigned char op) {
+  switch (op) {
+    case op_lti:
+    case op_addi:
+    case op_subi:
+    case op_list:
+    case op_const:
+    case op_push_args:
+    case op_load_from_stack:
+    case op_store_to_stack:
+    case op_call_function:
+    case op_call_symbol_function:
+    case op_tail_call:
+    case op_make_closure:
+    case op_load_closure:
+    case op_return_values:
+    case op_multiple_values:
+    case op_unbind:
+      return op_arg_varint;
+    case op_jump_forward:
+    case op_jump_backward:
+    case op_jump_forward_when_nil:
+      return op_arg_jump;
+    default:
+      return op_arg_none;
+  }
+}
+
+/* how many values an op (with the argument arg) pops and pushes -- *pops is -1 for ops that never appear
+   in bytecode. Ops that end the function (return-function) or jump are handled by verify_function. */
+void op_stack_effect(unsigned char op, ufixnum_t arg, int *pops, int *pushes) {
+  *pops = 0;
+  *pushes = 0;
+  switch (op) {
+    case op_load_nil:
+    case op_const:
+    case op_const_0:
+    case op_const_1:
+    case op_const_2:
+    case op_const_3:
+    case op_load_from_stack:
+    case op_load_from_stack_0:
+    case op_load_from_stack_1:
+    case op_load_closure:
+    case op_gensym:
+      *pushes = 1;
+      break;
+    case op_drop:
+    case op_store_to_stack:
+    case op_store_to_stack_0:
+    case op_store_to_stack_1:
+    case op_jump_forward_when_nil:
+    case op_print:
+    case op_return_function:
+      *pops = 1;
+      break;
+    case op_dup:
+      *pops = 1;
+      *pushes = 2;
+      break;
+    case op_intern:
+    case op_car:
+    case op_cdr:
+    case op_addi:
+    case op_subi:
+    case op_lti:
+    case op_symbol_value:
+    case op_symbol_function:
+    case op_symbol_type:
+    case op_symbol_name:
+    case op_type_of:
+    case op_to_string:
+    case op_alloc_struct:
+    case op_byte_stream:
+    case op_dynamic_array:
+    case op_dynamic_array_length:
+    case op_dynamic_array_pop:
+    case op_dynamic_byte_array:
+    case op_dynamic_byte_array_length:
+    case op_dynamic_byte_array_pop:
+    case op_function_code:
+    case op_unchecked_car:
+    case op_unchecked_cdr:
+      *pops = 1;
+      *pushes = 1;
+      break;
+    case op_cons:
+    case op_add:
+    case op_sub:
+    case op_mul:
+    case op_div:
+    case op_lt:
+    case op_gt:
+    case op_lte:
+    case op_gte:
+    case op_eq:
+    case op_and:
+    case op_or:
+    case op_bin_and:
+    case op_bin_or:
+    case op_shift_left:
+    case op_shift_right:
+    case op_set_symbol_value:
+    case op_set_symbol_function:
+    case op_dynamic_array_get:
+    case op_dynamic_array_push:
+    case op_dynamic_array_concat:
+    case op_dynamic_byte_array_concat:
+    case op_dynamic_byte_array_get:
+    case op_dynamic_byte_array_push:
+    case op_byte_stream_peek:
+    case op_byte_stream_read:
+    case op_struct_field:
+    case op_string_concat:
+    case op_write_file:
+    case op_fixnum_add:
+    case op_fixnum_sub:
+    case op_fixnum_mul:
+    case op_fixnum_lt:
+    case op_fixnum_gt:
+    case op_fixnum_lte:
+    case op_fixnum_gte:
+    case op_fixnum_eq:
+      *pops = 2;
+      *pushes = 1;
+      break;
+    case op_store_box:
+      *pops = 2;
+      break;
+    case op_dynamic_array_set:
+    case op_dynamic_byte_array_insert:
+    case op_dynamic_byte_array_set:
+    case op_set_struct_field:
+      *pops = 3;
+      *pushes = 1;
+      break;
+    case op_list: /* list 0 pushes nil */
+      *pops = arg;
+      *pushes = 1;
+      break;
+    case op_call_function: /* the arguments and the function are replaced by the result */
+    case op_call_symbol_function:
+    case op_tail_call: /* (a foreign function goes on to the next op) */
+    case op_make_closure: /* the values and the template are replaced by the closure */
+      *pops = arg + 1;
+      *pushes = 1;
+      break;
+    case op_return_values: /* (return-values 0 pushes nil to return) */
+      *pops = arg;
+      *pushes = 1;
+      break;
+    case op_multiple_values:
+      *pops = 1;
+      *pushes = arg;
+      break;
+    case op_bind:
+      *pops = 2;
+      *pushes = 0;
+      break;
+    case op_unbind:
+      *pops = 0;
+      *pushes = 0;
+      break;
+    case op_push_arg: /* arguments are already where they need to be */
+    case op_push_args:
+    case op_print_nl:
+    case op_jump_forward:
+    case op_jump_backward:
+      break;
+    default:
+      *pops = -1;
+      break;
+  }
+}
+
+/* Superinstructions
+ * A few pairs of ops are run far more often than the rest (bench/op-profile.sh lists them). Once a
+ * function is decoded the first instruction of each of these pairs is replaced with a superinstruction
+ * that does the work of both with a single dispatch. It reads the second op's argument from the
+ * instruction after it, which is left as it was -- so a jump to the second op still runs it on its own,
+ * and nothing that is indexed by instruction (jump targets, call caches) changes.
+ */
+
+/* the superinstruction for op0 followed by op1 (op0 if there isn't one) */
+unsigned char superinstruction_of(unsigned char op0, unsigned char op1) {
+  switch (op0) {
+    case op_load_nil:
+      if (op1 == op_drop) return op_load_nil_drop;
+      break;
+    case op_drop:
+      if (op1 == op_load_from_stack) return op_drop_load_from_stack;
+      break;
+    case op_load_from_stack:
+      switch (op1) {
+        case op_load_from_stack: return op_load_from_stack_load_from_stack;
+        case op_const:
+        case op_const_0:
+        case op_const_1:
+        case op_const_2:
+        case op_const_3: return op_load_from_stack_const;
+        case op_jump_forward_when_nil: return op_load_from_stack_jump_forward_when_nil;
+      }
+      break;
+    case op_lt:
+      if (op1 == op_jump_forward_when_nil) return op_lt_jump_forward_when_nil;
+      break;
+    case op_fixnum_lt:
+      if (op1 == op_jump_forward_when_nil) return op_fixnum_lt_jump_forward_when_nil;
+      break;
+  }
+  return op0;
+}
+
+void fuse_superinstructions(uint32_t *instructions, ufixnum_t instruction_count) {
+  ufixnum_t i;
+  unsigned char op, next_op, super_op;
+
+  for (i = 0; i + 1 < instruction_count; ++i) {
+    op = INSTRUCTION_OP(instructions[i]);
+    next_op = INSTRUCTION_OP(instructions[i + 1]);
+    super_op = superinstruction_of(op, next_op);
+    if (super_op == op) continue;
+    /* give the small const ops their index as an argument, so it can be read the same way as const's */
+    if (next_op >= op_const_0 && next_op <= op_const_3)
+      instructions[i + 1] = INSTRUCTION(next_op, next_op - op_const_0);
+    instructions[i] = INSTRUCTION(super_op, INSTRUCTION_ARG(instructions[i]));
+    ++i; /* the second op can't start another pair */
+  }
+}
+
+/* the op in bytecode that a decoded instruction's op stands for -- the generic op of a quickened op, and
+   the first op of a superinstruction */
+unsigned char bytecode_op_of(unsigned char op) {
+  switch (op) {
+    case op_add_fixnum_fixnum:
+    case op_add_flonum_flonum: return op_add;
+    case op_sub_fixnum_fixnum:
+    case op_sub_flonum_flonum: return op_sub;
+    case op_mul_fixnum_fixnum:
+    case op_mul_flonum_flonum: return op_mul;
+    case op_div_fixnum_fixnum:
+    case op_div_flonum_flonum: return op_div;
+    case op_gt_fixnum_fixnum:
+    case op_gt_flonum_flonum: return op_gt;
+    case op_lt_fixnum_fixnum:
+    case op_lt_flonum_flonum: return op_lt;
+    case op_gte_fixnum_fixnum:
+    case op_gte_flonum_flonum: return op_gte;
+    case op_lte_fixnum_fixnum:
+    case op_lte_flonum_flonum: return op_lte;
+    case op_load_nil_drop: return op_load_nil;
+    case op_drop_load_from_stack: return op_drop;
+    case op_load_from_stack_load_from_stack:
+    case op_load_from_stack_const:
+    case op_load_from_stack_jump_forward_when_nil: return op_load_from_stack;
+    case op_lt_jump_forward_when_nil: return op_lt;
+    case op_fixnum_lt_jump_forward_when_nil: return op_fixnum_lt;
+  }
+  return op;
+}
+
+/* the op that does what op (one of the unchecked ops for declared functions) does, but checks its operands'
+   types -- native code (see jit.c and aot.c) checks them anyway */
+unsigned char checked_op_of(unsigned char op) {
+  switch (op) {
+    case op_fixnum_add: return op_add;
+    case op_fixnum_sub: return op_sub;
+    case op_fixnum_mul: return op_mul;
+    case op_fixnum_lt: return op_lt;
+    case op_fixnum_gt: return op_gt;
+    case op_fixnum_lte: return op_lte;
+    case op_fixnum_gte: return op_gte;
+    case op_fixnum_eq: return op_eq;
+    case op_unchecked_car: return op_car;
+    case op_unchecked_cdr: return op_cdr;
+  }
+  return op;
+}
+
+/* Register form
+ * When REGISTERS is defined (the BUG_REGISTERS cmake option) decode_function also translates runs of
+ * simple ops (locals, constants, arithmetic, comparisons, car, cdr, cons and jump-forward-when-nil) into
+ * three-address register instructions that read and write the function's locals, its constants and the
+ * data stack directly -- so (set-local x (+ x 1)), which is load-from-stack, const, add and store-to-stack,
+ * becomes the one instruction add(local x, local x, const 1). Values that would have been pushed are kept
+ * track of (by op_stack_effect) as the operands they came from, and only the ones left at the end are
+ * written to the stack, in the slots they would have been pushed to -- so temporaries are stack slots.
+ *
+ * The first op of each run is replaced by op_registers, which runs the block and goes on from the op after
+ * it. The rest of the ops are left as they were. A run never has a jump target after its first op, so
+ * nothing can jump into the middle of it. Runs are only translated if that means fewer dispatches than
+ * their ops would take as superinstructions (a register instruction costs about as much as a dispatch).
+ *
+ * If the BUG_REGISTER_REPORT environment variable is set, the number of dispatches each function's blocks
+ * saved is written to the file it names when bug exits: one line per function with the dispatches its
+ * blocks' ops would have taken, the dispatches they took (op_registers and each register instruction) and
+ * the function's name.
+ */
+#ifdef REGISTERS
+enum register_op {
+  register_move,
+  register_add,
+  register_sub,
+  register_mul,
+  register_lt,
+  register_gt,
+  register_lte,
+  register_gte,
+  register_eq,
+  register_car,
+  register_cdr,
+  register_cons
+};
+
+#define REGISTER_BLOCK_MAX 16 /* the most values and instructions a block keeps track of */
+
+/* what is kept while translating a block */
+struct register_translation {
+  struct register_instruction instructions[REGISTER_BLOCK_MAX];
+  int count;
+  struct register_operand values[REGISTER_BLOCK_MAX]; /* the operands of the values that were pushed */
+  int length;
+  int low; /* the stack index of values[0] -- negative once values that were already on the stack are popped */
+};
+
+static struct object *register_functions; /* the functions that have blocks (for register_report_write) */
+
+struct register_operand register_operand(unsigned char base, int32_t index) {
+  struct register_operand operand;
+  operand.base = base;
+  operand.index = index;
+  return operand;
+}
+
+#define IS_REGISTER_OPERAND(x, b, n) ((x).base == (b) && (x).index == (n))
+
+void register_emit(struct register_translation *t, unsigned char op, struct register_operand dst,
+                   struct register_operand a, struct register_operand b) {
+  struct register_instruction *instruction;
+  instruction = &t->instructions[t->count++];
+  instruction->op = op;
+  instruction->dst = dst;
+  instruction->a = a;
+  instruction->b = b;
+}
+
+void register_push(struct register_translation *t, struct register_operand value) {
+  t->values[t->length++] = value;
+}
+
+struct register_operand register_pop(struct register_translation *t) {
+  if (t->length == 0) return register_operand(register_stack, --t->low); /* a value from before the block */
+  return t->values[--t->length];
+}
+
+/* writes the values from the kth up (that match, or all if match is NULL) to their stack slots */
+void register_materialize(struct register_translation *t, int k, struct register_operand *match) {
+  struct register_operand slot;
+  for (; k < t->length; ++k) {
+    slot = register_operand(register_stack, t->low + k);
+    if (IS_REGISTER_OPERAND(t->values[k], slot.base, slot.index)) continue;
+    if (match != NULL && !IS_REGISTER_OPERAND(t->values[k], match->base, match->index)) continue;
+    register_emit(t, register_move, slot, t->values[k], t->values[k]);
+    t->values[k] = slot;
+  }
+}
+
+/* whether x is the result of the last instruction, and nothing else is going to read it (so the result can be
+   written somewhere else instead) */
+int register_is_last_result(struct register_translation *t, struct register_operand x) {
+  int k;
+  if (t->count == 0 || x.base != register_stack || x.index < 0) return 0;
+  if (!IS_REGISTER_OPERAND(t->instructions[t->count - 1].dst, x.base, x.index)) return 0;
+  for (k = 0; k < t->length; ++k)
+    if (IS_REGISTER_OPERAND(t->values[k], x.base, x.index)) return 0;
+  return 1;
+}
+
+/* how many register instructions (at most) translating op would add */
+int register_instructions_for(struct register_translation *t, unsigned char op) {
+  switch (op) {
+    case op_store_to_stack:
+    case op_store_to_stack_0:
+    case op_store_to_stack_1:
+      return t->length + 1; /* values that are the local have to be written to the stack first */
+    case op_jump_forward_when_nil:
+      return t->length + 1;
+    default:
+      return 1;
+  }
+}
+
+/* whether translate_register_block can translate op */
+char is_register_translatable(unsigned char op) {
+  switch (op) {
+    case op_load_nil:
+    case op_const:
+    case op_const_0:
+    case op_const_1:
+    case op_const_2:
+    case op_const_3:
+    case op_load_from_stack:
+    case op_load_from_stack_0:
+    case op_load_from_stack_1:
+    case op_store_to_stack:
+    case op_store_to_stack_0:
+    case op_store_to_stack_1:
+    case op_drop:
+    case op_dup:
+    case op_push_arg:
+    case op_car:
+    case op_cdr:
+    case op_jump_forward_when_nil:
+    case op_cons:
+    case op_add:
+    case op_sub:
+    case op_mul:
+    case op_lt:
+    case op_gt:
+    case op_lte:
+    case op_gte:
+    case op_eq:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/* how many dispatches the ops from start to end take once superinstructions are fused */
+ufixnum_t fused_dispatches(uint32_t *instructions, ufixnum_t start, ufixnum_t end) {
+  ufixnum_t i, dispatches;
+  unsigned char op;
+  dispatches = 0;
+  for (i = start; i < end; ++i, ++dispatches) {
+    op = INSTRUCTION_OP(instructions[i]);
+    if (i + 1 < end && superinstruction_of(op, INSTRUCTION_OP(instructions[i + 1])) != op) ++i;
+  }
+  return dispatches;
+}
+
+/* translates the ops from start (up to the next jump target) into block -- returns how many ops it does,
+   or 0 if translating them wouldn't save any dispatches (over the superinstructions they would be) */
+ufixnum_t translate_register_block(uint32_t *instructions, ufixnum_t instruction_count, ufixnum_t start,
+                                   char *is_jump_target, struct register_block *block) {
+  struct register_translation t;
+  struct register_operand a, b, dst;
+  unsigned char op, register_op;
+  ufixnum_t i, arg;
+  int pops, pushes, count;
+
+  t.count = t.length = t.low = 0;
+  block->jump = -1;
+  for (i = start; i < instruction_count; ++i) {
+    if (i > start && is_jump_target[i]) break;
+    op = checked_op_of(INSTRUCTION_OP(instructions[i])); /* (blocks check types anyway) */
+    arg = INSTRUCTION_ARG(instructions[i]);
+    if (!is_register_translatable(op)) break;
+    op_stack_effect(op, arg, &pops, &pushes);
+    if (t.length - pops + pushes > REGISTER_BLOCK_MAX) break;
+    if (t.count + register_instructions_for(&t, op) > REGISTER_BLOCK_MAX) break;
+    switch (op) {
+      case op_load_nil:
+        register_push(&t, register_operand(register_nil, 0));
+        break;
+      case op_const_0:
+      case op_const_1:
+      case op_const_2:
+      case op_const_3:
+        arg = op - op_const_0;
+      case op_const:
+        register_push(&t, register_operand(register_constants, arg));
+        break;
+      case op_load_from_stack_0:
+      case op_load_from_stack_1:
+        arg = op - op_load_from_stack_0;
+      case op_load_from_stack:
+        register_push(&t, register_operand(register_locals, arg));
+        break;
+      case op_store_to_stack_0:
+      case op_store_to_stack_1:
+        arg = op - op_store_to_stack_0;
+      case op_store_to_stack:
+        dst = register_operand(register_locals, arg);
+        a = register_pop(&t);
+        if (IS_REGISTER_OPERAND(a, dst.base, dst.index)) break; /* storing a local to itself */
+        /* values that are still the local need to be read before it changes */
+        count = t.count;
+        register_materialize(&t, 0, &dst);
+        if (count == t.count && register_is_last_result(&t, a))
+          t.instructions[t.count - 1].dst = dst; /* the result goes straight to the local */
+        else
+          register_emit(&t, register_move, dst, a, a);
+        break;
+      case op_drop:
+        register_pop(&t);
+        break;
+      case op_dup:
+        a = register_pop(&t);
+        register_push(&t, a);
+        register_push(&t, a);
+        break;
+      case op_push_arg:
+        break;
+      case op_car:
+      case op_cdr:
+        a = register_pop(&t);
+        dst = register_operand(register_stack, t.low + t.length);
+        register_emit(&t, op == op_car ? register_car : register_cdr, dst, a, a);
+        register_push(&t, dst);
+        break;
+      case op_jump_forward_when_nil:
+        a = register_pop(&t);
+        dst = register_operand(register_condition, 0);
+        if (register_is_last_result(&t, a))
+          t.instructions[t.count - 1].dst = dst; /* the result is only needed to jump */
+        else
+          register_emit(&t, register_move, dst, a, a);
+        register_materialize(&t, 0, NULL);
+        block->jump = arg;
+        break;
+      default:
+        switch (op) {
+          case op_add: register_op = register_add; break;
+          case op_sub: register_op = register_sub; break;
+          case op_mul: register_op = register_mul; break;
+          case op_lt: register_op = register_lt; break;
+          case op_gt: register_op = register_gt; break;
+          case op_lte: register_op = register_lte; break;
+          case op_gte: register_op = register_gte; break;
+          case op_eq: register_op = register_eq; break;
+          default: register_op = register_cons; break;
+        }
+        b = register_pop(&t);
+        a = register_pop(&t);
+        dst = register_operand(register_stack, t.low + t.length);
+        register_emit(&t, register_op, dst, a, b);
+        register_push(&t, dst);
+        break;
+    }
+    if (op == op_jump_forward_when_nil) {
+      ++i;
+      break;
+    }
+  }
+  if (block->jump == (ufixnum_t)-1) register_materialize(&t, 0, NULL);
+  block->dispatches = fused_dispatches(instructions, start, i);
+  if (t.count + 1 >= (int)block->dispatches) return 0;
+
+  block->word = instructions[start];
+  block->next = i;
+  block->sp_change = t.low + t.length;
+  block->count = t.count;
+  block->runs = 0;
+  block->instructions = malloc(sizeof(struct register_instruction) * t.count);
+  if (block->instructions == NULL) {
+    printf("Failed to allocate register instructions.\n");
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  memcpy(block->instructions, t.instructions, sizeof(struct register_instruction) * t.count);
+  return i - start;
+}
+
+/* replaces runs of ops in f's (just decoded) instructions with register blocks */
+void translate_registers(struct object *f, uint32_t *instructions, ufixnum_t instruction_count) {
+  struct register_block block, *blocks;
+  ufixnum_t i, n, count, capacity;
+  char *is_jump_target;
+  unsigned char op;
+
+  is_jump_target = calloc(instruction_count + 1, 1);
+  if (is_jump_target == NULL) {
+    printf("Failed to allocate jump targets.\n");
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  for (i = 0; i < instruction_count; ++i) {
+    op = INSTRUCTION_OP(instructions[i]);
+    if (op_arg_kind_of(op) == op_arg_jump) is_jump_target[INSTRUCTION_ARG(instructions[i])] = 1;
+  }
+
+  /* blocks from before the code was replaced are kept (old instructions that are still running use them) */
+  blocks = FUNCTION_REGISTER_BLOCKS(f);
+  count = capacity = FUNCTION_REGISTER_BLOCK_COUNT(f);
+  for (i = 0; i < instruction_count; ++i) {
+    n = translate_register_block(instructions, instruction_count, i, is_jump_target, &block);
+    if (n == 0) continue;
+    if (count == capacity) {
+      capacity = capacity == 0 ? 4 : capacity * 2;
+      blocks = realloc(blocks, sizeof(struct register_block) * capacity);
+      if (blocks == NULL) {
+        printf("Failed to allocate register blocks.\n");
+        PRINT_STACK_TRACE_AND_QUIT();
+      }
+    }
+    blocks[count] = block;
+    instructions[i] = INSTRUCTION(op_registers, count);
+    ++count;
+    i += n - 1;
+  }
+  free(is_jump_target);
+
+  if (FUNCTION_REGISTER_BLOCK_COUNT(f) == 0 && count > 0) {
+    if (register_functions == NULL) register_functions = dynamic_array(64);
+    dynamic_array_push(register_functions, f);
+  }
+  FUNCTION_REGISTER_BLOCKS(f) = blocks;
+  FUNCTION_REGISTER_BLOCK_COUNT(f) = count;
+}
+
+/* reads a register operand -- bases are the locals, the constants, the data stack (where sp was when the
+   block started), nil and the block's condition */
+#define REGISTER_READ(x) bases[(x).base][(x).index]
+
+/* like run's TARGET and NEXT (see "Dispatch") -- with THREADED_DISPATCH each register op jumps straight to
+   the next instruction's op */
+#ifdef THREADED_DISPATCH
+#define REGISTER_TARGET(op) case op: label_##op
+#define REGISTER_DISPATCH()                    \
+  {                                            \
+    a = REGISTER_READ(instruction->a);         \
+    b = REGISTER_READ(instruction->b);         \
+    goto *register_targets[instruction->op];   \
+  }
+#else
+#define REGISTER_TARGET(op) case op
+#define REGISTER_DISPATCH() continue
+#endif
+#define REGISTER_NEXT(x)                            \
+  {                                                 \
+    REGISTER_READ(instruction->dst) = (x);          \
+    if (++instruction == end) goto end_of_block;    \
+    REGISTER_DISPATCH();                            \
+  }
+
+#ifdef THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic" /* labels as values are a GNU extension (see "Dispatch") */
+#endif
+/* runs a block (the room run made for f's max_depth is room for it) -- returns the instruction to go on from */
+ufixnum_t run_register_block(struct register_block *block, struct object **locals, struct object **constants,
+                             struct object **sp) {
+  struct object **bases[5], *nil, *condition, *a, *b;
+  struct register_instruction *instruction, *end;
+#ifdef THREADED_DISPATCH
+  static void *register_targets[] = {
+      &&label_register_move, &&label_register_add, &&label_register_sub, &&label_register_mul,
+      &&label_register_lt,   &&label_register_gt,  &&label_register_lte, &&label_register_gte,
+      &&label_register_eq,   &&label_register_car, &&label_register_cdr, &&label_register_cons};
+#endif
+
+  nil = NIL;
+  bases[register_locals] = locals;
+  bases[register_constants] = constants;
+  bases[register_stack] = sp;
+  bases[register_nil] = &nil;
+  bases[register_condition] = &condition;
+  ++block->runs;
+  instruction = block->instructions;
+  end = instruction + block->count;
+  if (instruction == end) goto end_of_block; /* (a block can be just ops that cancel out, like load-nil drop) */
+  while (1) {
+    a = REGISTER_READ(instruction->a);
+    b = REGISTER_READ(instruction->b);
+    switch (instruction->op) {
+      REGISTER_TARGET(register_move):
+        REGISTER_NEXT(a);
+      REGISTER_TARGET(register_add):
+        REGISTER_NEXT(BOTH_FIXNUMS(a, b) ? fixnum(IMMEDIATE_FIXNUM_VALUE(a) + IMMEDIATE_FIXNUM_VALUE(b))
+                                         : arithmetic("add", op_add, a, b));
+      REGISTER_TARGET(register_sub):
+        REGISTER_NEXT(BOTH_FIXNUMS(a, b) ? fixnum(IMMEDIATE_FIXNUM_VALUE(a) - IMMEDIATE_FIXNUM_VALUE(b))
+                                         : arithmetic("subtract", op_sub, a, b));
+      REGISTER_TARGET(register_mul):
+        REGISTER_NEXT(BOTH_FIXNUMS(a, b) ? fixnum(IMMEDIATE_FIXNUM_VALUE(a) * IMMEDIATE_FIXNUM_VALUE(b))
+                                         : arithmetic("multiply", op_mul, a, b));
+      /* tagging keeps the order of immediate fixnums */
+      REGISTER_TARGET(register_lt):
+        REGISTER_NEXT((BOTH_FIXNUMS(a, b) ? (intptr_t)a < (intptr_t)b : compare_numbers("compare", op_lt, a, b)) ? T : NIL);
+      REGISTER_TARGET(register_gt):
+        REGISTER_NEXT((BOTH_FIXNUMS(a, b) ? (intptr_t)a > (intptr_t)b : compare_numbers("compare", op_gt, a, b)) ? T : NIL);
+      REGISTER_TARGET(register_lte):
+        REGISTER_NEXT((BOTH_FIXNUMS(a, b) ? (intptr_t)a <= (intptr_t)b : compare_numbers("compare", op_lte, a, b)) ? T : NIL);
+      REGISTER_TARGET(register_gte):
+        REGISTER_NEXT((BOTH_FIXNUMS(a, b) ? (intptr_t)a >= (intptr_t)b : compare_numbers("compare", op_gte, a, b)) ? T : NIL);
+      REGISTER_TARGET(register_eq):
+        REGISTER_NEXT(equals(a, b) ? T : NIL);
+      REGISTER_TARGET(register_car):
+        if (a != NIL && type_of(a) != gis->cons_type) {
+          printf("Can only car a list (was given a %s).\n", type_name_of_cstr(a));
+          PRINT_STACK_TRACE_AND_QUIT();
+        }
+        REGISTER_NEXT(a == NIL ? NIL : CONS_CAR(a));
+      REGISTER_TARGET(register_cdr):
+        if (a != NIL && type_of(a) != gis->cons_type) {
+          printf("Can only cdr a list (was given a %s).\n", type_name_of_cstr(a));
+          PRINT_STACK_TRACE_AND_QUIT();
+        }
+        REGISTER_NEXT(a == NIL ? NIL : CONS_CDR(a));
+      REGISTER_TARGET(register_cons):
+        REGISTER_NEXT(cons(a, b));
+    }
+  }
+end_of_block:
+  return block->jump != (ufixnum_t)-1 && condition == NIL ? block->jump : block->next;
+}
+#ifdef THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
+
+void register_report_write() {
+  struct object *f;
+  struct register_block *block;
+  unsigned long before, after;
+  ufixnum_t i, k;
+  FILE *file;
+
+  file = fopen(getenv("BUG_REGISTER_REPORT"), "w");
+  if (file == NULL) {
+    printf("Failed to open the register report file.\n");
+    return;
+  }
+  for (i = 0; register_functions != NULL && i < DYNAMIC_ARRAY_LENGTH(register_functions); ++i) {
+    f = DYNAMIC_ARRAY_VALUES(register_functions)[i];
+    before = after = 0;
+    for (k = 0; k < FUNCTION_REGISTER_BLOCK_COUNT(f); ++k) {
+      block = &FUNCTION_REGISTER_BLOCKS(f)[k];
+      before += block->runs * block->dispatches;
+      after += block->runs * (block->count + 1);
+    }
+    if (before == 0) continue;
+    if (FUNCTION_NAME(f) != NIL) {
+      dynamic_byte_array_force_cstr(SYMBOL_NAME(FUNCTION_NAME(f)));
+      fprintf(file, "%lu %lu %s\n", before, after, STRING_CONTENTS(SYMBOL_NAME(FUNCTION_NAME(f))));
+    } else {
+      fprintf(file, "%lu %lu <anonymous-function>\n", before, after);
+    }
+  }
+  fclose(file);
+}
+
+void register_report_init() {
+  if (getenv("BUG_REGISTER_REPORT") != NULL) add_exit_report(register_report_write);
+}
+#endif
+
+/* the instruction at i as decode_function made it (before it was replaced by a register block) */
+uint32_t decoded_instruction(struct object *f, ufixnum_t i) {
+  uint32_t word;
+  word = FUNCTION_INSTRUCTIONS(f)[i];
+#ifdef REGISTERS
+  if (INSTRUCTION_OP(word) == op_registers) return FUNCTION_REGISTER_BLOCKS(f)[INSTRUCTION_ARG(word)].word;
+#endif
+  return word;
+}
+
+/* Verifier
+ * decode_function checks a function's instructions before they are ever run: that each op is one that can
+ * be in bytecode, that the locals it uses are in the function's frame, and that the data stack never has
+ * fewer values than the function started with, and has the same number however an instruction is reached.
+ * The most values the stack ever has (over the locals) is kept as the function's max_depth, so run makes
+ * room for all of them once when it starts (or goes back to) the function -- its ops don't check that there
+ * are values to pop or room to push.
+ */
+
+/* the stack has depth values when the instruction at target is reached (from the instruction at from) */
+void verify_branch(fixnum_t *depths, ufixnum_t *worklist, ufixnum_t *worklist_length, ufixnum_t target,
+                   fixnum_t depth, ufixnum_t from) {
+  if (depths[target] == -1) {
+    depths[target] = depth;
+    worklist[(*worklist_length)++] = target;
+  } else if (depths[target] != depth) {
+    printf("BC: instruction %lu is reached with %ld values on the stack from instruction %lu, but with %ld from elsewhere.\n",
+           (unsigned long)target, (long)depth, (unsigned long)from, (long)depths[target]);
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+}
+
+/* checks f's (just decoded) instructions, and sets its max_depth */
+void verify_function(struct object *f, uint32_t *instructions, ufixnum_t instruction_count) {
+  fixnum_t *depths; /* how many values are on the stack before each instruction (-1 if it isn't reached) */
+  ufixnum_t *worklist; /* instructions whose depth is known, but haven't been checked */
+  ufixnum_t worklist_length, i, arg, frame_size;
+  fixnum_t depth, max_depth;
+  unsigned char op;
+  int pops, pushes;
+
+  depths = malloc(sizeof(fixnum_t) * (instruction_count + 1));
+  worklist = malloc(sizeof(ufixnum_t) * (instruction_count + 1));
+  if (depths == NULL || worklist == NULL) {
+    printf("Failed to allocate the verifier's depths.\n");
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  for (i = 0; i <= instruction_count; ++i) depths[i] = -1;
+  frame_size = FUNCTION_STACK_SIZE(f) < FUNCTION_NARGS(f) ? FUNCTION_NARGS(f) : FUNCTION_STACK_SIZE(f);
+
+  max_depth = 0;
+  worklist_length = 0;
+  verify_branch(depths, worklist, &worklist_length, 0, 0, 0);
+  while (worklist_length > 0) {
+    i = worklist[--worklist_length];
+    if (i == instruction_count) continue; /* running off the end stops the function (with anything on the stack) */
+    depth = depths[i];
+    op = INSTRUCTION_OP(instructions[i]);
+    arg = INSTRUCTION_ARG(instructions[i]);
+
+    op_stack_effect(op, arg, &pops, &pushes);
+    if (pops < 0) {
+      printf("BC: invalid op %d at instruction %lu.\n", (int)op, (unsigned long)i);
+      PRINT_STACK_TRACE_AND_QUIT();
+    }
+    if (op == op_load_from_stack_0 || op == op_store_to_stack_0) arg = 0;
+    if (op == op_load_from_stack_1 || op == op_store_to_stack_1) arg = 1;
+    if ((op == op_load_from_stack || op == op_load_from_stack_0 || op == op_load_from_stack_1 ||
+         op == op_store_to_stack || op == op_store_to_stack_0 || op == op_store_to_stack_1) &&
+        arg >= frame_size) {
+      printf("BC: instruction %lu uses local %lu, but the function only has %lu locals.\n", (unsigned long)i,
+             (unsigned long)arg, (unsigned long)frame_size);
+      PRINT_STACK_TRACE_AND_QUIT();
+    }
+    if (depth < pops) {
+      printf("BC: instruction %lu pops %d values, but the stack only has %ld.\n", (unsigned long)i, pops, (long)depth);
+      PRINT_STACK_TRACE_AND_QUIT();
+    }
+    depth += pushes - pops;
+    if (depth > max_depth) max_depth = depth;
+
+    if (op == op_return_function || op == op_return_values) continue;
+    if (op_arg_kind_of(op) == op_arg_jump) {
+      verify_branch(depths, worklist, &worklist_length, arg, depth, i);
+      if (op != op_jump_forward_when_nil) continue;
+    }
+    verify_branch(depths, worklist, &worklist_length, i + 1, depth, i);
+  }
+
+  FUNCTION_MAX_DEPTH(f) = max_depth;
+  free(depths);
+  free(worklist);
+}
+
+/* Decodes f's code into instruction words (see INSTRUCTION in bug.h), so run doesn't have to
+   decode arguments (or check them) every time an op is executed. */
+void decode_function(struct object *f) {
+  struct dynamic_byte_array *code;
+  struct dynamic_array *constants;
+  unsigned char op, byte;
+  ufixnum_t i, n, start, shift;
+  ufixnum_t *instruction_index; /* the instruction index of each op (indexed by byte) */
+  uint32_t *instructions;
+  unsigned long arg;
+  fixnum_t target;
+  char has_calls;
+
+  code = FUNCTION_CODE(f)->w1.value.dynamic_byte_array;
+  constants = FUNCTION_CONSTANTS(f)->w1.value.dynamic_array;
+
+  /* find where each op starts, so jump offsets can be turned into instruction indexes */
+  instruction_index = malloc(sizeof(ufixnum_t) * (code->length + 1));
+  if (instruction_index == NULL) {
+    printf("Failed to allocate instruction indexes.");
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  n = 0;
+  i = 0;
+  while (i < code->length) {
+    start = i;
+    instruction_index[i] = n;
+    op = code->bytes[i++];
+    if (op_arg_kind_of(op) == op_arg_varint) {
+      do {
+        if (i >= code->length) {
+          printf("BC: expected an op code argument, but bytecode ended.\n");
+          PRINT_STACK_TRACE_AND_QUIT();
+        }
+        byte = code->bytes[i++];
+      } while (byte & 0x80);
+    } else if (op_arg_kind_of(op) == op_arg_jump) {
+      if (i + 2 > code->length) {
+        printf("BC: expected a jump argument, but bytecode ended.\n");
+        PRINT_STACK_TRACE_AND_QUIT();
+      }
+      i += 2;
+    }
+    while (++start < i) instruction_index[start] = -1; /* not the start of an op */
+    ++n;
+  }
+  instruction_index[code->length] = n;
+
+  instructions = malloc(sizeof(uint32_t) * (n > 0 ? n : 1));
+  if (instructions == NULL) {
+    printf("Failed to allocate instructions.");
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  n = 0;
+  i = 0;
+  has_calls = 0;
+  while (i < code->length) {
+    op = code->bytes[i++];
+    arg = 0;
+    if (op == op_call_function || op == op_call_symbol_function || op == op_tail_call) has_calls = 1;
+    if (op_arg_kind_of(op) == op_arg_varint) {
+      shift = 0;
+      do {
+        byte = code->bytes[i++];
+        arg |= (unsigned long)(byte & 0x7F) << shift;
+        shift += 7;
+      } while (byte & 0x80);
+      if (arg > MAX_INSTRUCTION_ARG) {
+        printf("BC: op code argument %lu is too large (the maximum is %lu).\n", arg, (unsigned long)MAX_INSTRUCTION_ARG);
+        PRINT_STACK_TRACE_AND_QUIT();
+      }
+    } else if (op_arg_kind_of(op) == op_arg_jump) {
+      arg = (code->bytes[i] << 8) | code->bytes[i + 1];
+      i += 2;
+      target = op == op_jump_backward ? (fixnum_t)(i - 1) - (fixnum_t)arg : (fixnum_t)(i - 1) + (fixnum_t)arg;
+      if (target >= (fixnum_t)code->length) { /* jumping past the end stops the function */
+        arg = instruction_index[code->length];
+      } else if (target < 0 || instruction_index[target] == (ufixnum_t)-1) {
+        printf("BC: jump to byte %ld is not the start of an op.\n", (long)target);
+        PRINT_STACK_TRACE_AND_QUIT();
+      } else {
+        arg = instruction_index[target];
+      }
+    }
+
+    /* check the constants vector is big enough once here instead of every time the op is run */
+    if ((op == op_const && arg >= constants->length) ||
+        (op == op_const_0 && constants->length < 1) ||
+        (op == op_const_1 && constants->length < 2) ||
+        (op == op_const_2 && constants->length < 3) ||
+        (op == op_const_3 && constants->length < 4)) {
+      printf("BC: bytecode attempted to access an out of bounds index in the constants vector, but only have %ld constants.\n",
+             (long)constants->length);
+      PRINT_STACK_TRACE_AND_QUIT();
+    }
+
+    instructions[n++] = INSTRUCTION(op, arg);
+  }
+
+  free(instruction_index);
+  verify_function(f, instructions, n);
+#ifndef OP_PROFILE
+#ifdef REGISTERS
+  translate_registers(f, instructions, n);
+#endif
+  fuse_superinstructions(instructions, n);
+#endif
+  FUNCTION_INSTRUCTIONS(f) = instructions;
+  FUNCTION_INSTRUCTION_COUNT(f) = n;
+  FUNCTION_CODE_VERSION(f) = DYNAMIC_BYTE_ARRAY_VERSION(FUNCTION_CODE(f));
+  /* caches are indexed by instruction (they are replaced with the instructions -- see redecode_function) */
+  if (has_calls) {
+    FUNCTION_CALL_CACHES(f) = calloc(n, sizeof(struct call_cache));
+    if (FUNCTION_CALL_CACHES(f) == NULL) {
+      printf("Failed to allocate call caches.");
+      PRINT_STACK_TRACE_AND_QUIT();
+    }
+  } else {
+    FUNCTION_CALL_CACHES(f) = NULL;
+  }
+}
+
+/* keeps p (instructions or call caches that were replaced) until bug exits */
+void retire_decoded(void *p) {
+  ufixnum_t k;
+  if (p == NULL) return;
+  for (k = 0; k < gis->vm.retired_length; ++k)
+    if (gis->vm.retired[k] == p) return; /* (a closure that shares them was decoded again first) */
+  if (gis->vm.retired_length == gis->vm.retired_capacity) {
+    gis->vm.retired_capacity = gis->vm.retired_capacity == 0 ? 16 : gis->vm.retired_capacity * 2;
+    gis->vm.retired = realloc(gis->vm.retired, sizeof(void *) * gis->vm.retired_capacity);
+    if (gis->vm.retired == NULL) {
+      printf("Failed to allocate retired instructions.");
+      PRINT_STACK_TRACE_AND_QUIT();
+    }
+  }
+  gis->vm.retired[gis->vm.retired_length++] = p;
+}
+
+/* Decodes f's code again if it was changed (its version isn't the one f was decoded from), when f is called.
+   A call made while f is still running (a frame on the call stack returns to it) keeps the old instructions,
+   since the frame's instruction index is one of theirs. The old instructions and call caches are freed --
+   unless a closure shares them (see make_closure), which may still be running them, so they are retired. */
+void redecode_function(struct object *f) {
+  uint32_t *instructions;
+  struct call_cache *call_caches;
+  ufixnum_t k;
+
+  for (k = 0; k < gis->vm.frames_length; ++k)
+    if (gis->vm.frames[k].f == f) return;
+
+  instructions = FUNCTION_INSTRUCTIONS(f);
+  call_caches = FUNCTION_CALL_CACHES(f);
+  decode_function(f);
+  if (FUNCTION_SHARES_INSTRUCTIONS(f)) {
+    retire_decoded(instructions);
+    retire_decoded(call_caches);
+  } else {
+    free(instructions);
+    free(call_caches);
+  }
+#ifdef JIT
+  if (FUNCTION_JIT(f) != NULL) {
+    jit_free(FUNCTION_JIT(f));
+    FUNCTION_JIT(f) = NULL;
+  }
+#endif
+#ifdef AOT
+  FUNCTION_AOT(f) = NULL; /* (it was compiled from the old code) */
+#endif
+}
+
+#define READ_OP_ARG() a0 = INSTRUCTION_ARG(word)
+
+#define READ_OP_JUMP_ARG() sa0 = INSTRUCTION_ARG(word)
+
+#define READ_CONST_ARG() \
+  READ_OP_ARG();         \
+  c0 = constants->values[a0];
+
+/* Stack caching
+ * run keeps its own pointers into the data stack in C locals (which the C compiler can keep in
+ * registers), so pushing, popping and reading the top of the stack don't go through gis. The data
+ * stack's length is only brought up to date (SAVE_STACK) before anything else looks at the stack --
+ * calls, builtins and returns -- and the pointers are loaded again (LOAD_STACK) afterwards, since
+ * the stack may have grown (moving its values) in the meantime. None of these are used outside run.
+ *
+ * sp          -- just past the top of the stack
+ * stack_limit -- the end of the stack's capacity
+ * locals      -- the current function's first local
+ *
+ * Pushing doesn't check for room: when run starts a function (or goes back to it) it makes room for the
+ * most values the function can push (its max_depth -- see "Verifier").
+ */
+#define SAVE_STACK() stack->length = sp - stack->values
+#define LOAD_STACK()                                   \
+  {                                                    \
+    sp = stack->values + stack->length;                \
+    stack_limit = stack->values + stack->capacity;     \
+    locals = stack->values + fp;                       \
+  }
+/* grows the stack (if it needs to) so n values can be written from sp */
+#define ENSURE_STACK_ROOM(n)                          \
+  if (sp + (n) > stack_limit) {                       \
+    SAVE_STACK();                                     \
+    dynamic_array_reserve(gis->data_stack, (n));      \
+    LOAD_STACK();                                     \
+  }
+
+#define PUSH(x) *sp++ = (x)
+#define POP() (*--sp)
+
+#if defined(JIT) || defined(AOT)
+/* runs f's native code from instruction i (run_native is the call that does it) -- it comes back at the
+   instruction to carry on interpreting from (see jit.c and aot.c) */
+#define ENTER_NATIVE(run_native)                   \
+  {                                                \
+    native_state.sp = sp;                          \
+    native_state.locals = locals;                  \
+    native_state.constants = constants->values;    \
+    i = run_native;                                \
+    sp = native_state.sp;                          \
+  }
+#endif
+
+#ifdef AOT
+#define ENTER_AOT() ENTER_NATIVE(FUNCTION_AOT(f)->run(&native_state, i))
+#define HAS_AOT(f) (FUNCTION_AOT(f) != NULL)
+#else
+#define HAS_AOT(f) 0
+#endif
+
+#ifdef JIT
+/* counts a call (or loop) of f, and compiles it once it is hot (functions compiled ahead of time never are) */
+#define WARM_JIT()                                                                   \
+  if (FUNCTION_JIT(f) == NULL && !HAS_AOT(f) && ++FUNCTION_HEAT(f) > jit_threshold) \
+    FUNCTION_JIT(f) = jit_compile(f);
+#define ENTER_JIT() ENTER_NATIVE(jit_run(FUNCTION_JIT(f), &native_state, i))
+#endif
+
+/* Gets the item in the data stack at the index i. (e.g. STACK_I(0) is the top
+ * of the stack) */
+#define STACK_I(i) sp[-1 - (i)]
+
+/* the current function's nth local */
+#define LOCAL(n) locals[n]
+
+/* checks the number of arguments being passed to new_f (the top nargs values under the function
+   being called), and makes them its parameters (see "Parameters"). returns the number of locals the
+   parameters take up, and sets *rest to the rest list if its conses are reused (NIL if not) */
+unsigned long prepare_arguments(unsigned long nargs, struct object *new_f, struct object **rest) {
+  ufixnum_t fp, nparams, nlocals, j;
+  struct object **values;
+  struct object *list;
+
+  *rest = NIL;
+  nparams = FUNCTION_NARGS(new_f) + FUNCTION_NOPTIONAL(new_f);
+  if (nargs < FUNCTION_NARGS(new_f) || (nargs > nparams && FUNCTION_REST(new_f) == rest_none)) {
+    printf("Function was passed invalid number of arguments.\n");
+    print(new_f);
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  if (FUNCTION_NOPTIONAL(new_f) == 0 && FUNCTION_REST(new_f) == rest_none) return nargs;
+
+  /* (the locals after the arguments are written before init_locals makes room for them) */
+  fp = DYNAMIC_ARRAY_LENGTH(gis->data_stack) - nargs - 1;
+  nlocals = nparams + (FUNCTION_REST(new_f) != rest_none) + (FUNCTION_NOPTIONAL(new_f) > 0);
+  if (fp + nlocals > DYNAMIC_ARRAY_LENGTH(gis->data_stack))
+    dynamic_array_reserve(gis->data_stack, fp + nlocals - DYNAMIC_ARRAY_LENGTH(gis->data_stack));
+  values = DYNAMIC_ARRAY_VALUES(gis->data_stack) + fp;
+
+  list = NIL;
+  if (nargs > nparams) {
+    list = make_rest_list(values + nparams, nargs - nparams, FUNCTION_REST(new_f) == rest_reused);
+    if (FUNCTION_REST(new_f) == rest_reused) *rest = list;
+    nargs = nparams;
+  }
+  for (j = nargs; j < nparams; ++j) values[j] = NIL; /* the optional arguments that weren't given */
+  j = nparams;
+  if (FUNCTION_REST(new_f) != rest_none) values[j++] = list;
+  if (FUNCTION_NOPTIONAL(new_f) > 0) values[j++] = fixnum(nargs);
+  return nlocals;
+}
+
+/* makes the top nargs values on the data stack (under the function being called) the first
+   locals of new_f, and saves the registers of the caller */
+void prepare_function_call(unsigned long nargs, struct object *old_f, ufixnum_t old_i, struct object *new_f) {
+  ufixnum_t fp;
+  struct object *rest;
+
+  fp = DYNAMIC_ARRAY_LENGTH(gis->data_stack) - nargs - 1; /* the function is on top of its arguments */
+  nargs = prepare_arguments(nargs, new_f, &rest);
+
+  /* the arguments are already in place -- this initializes the rest of the locals (overwriting the function) */
+  init_locals(new_f, fp, nargs);
+
+  push_frame(old_f, old_i + 1, gis->vm.fp); /* resume at the next instruction */
+  gis->vm.frames[gis->vm.frames_length - 1].rest = rest;
+  gis->vm.f = new_f;
+  gis->vm.i = 0; /* start the bytecode interpreter at the first instruction */
+  gis->vm.fp = fp;
+}
+
+/* like prepare_function_call, but new_f takes over the frame of the function making the call:
+   the arguments are moved down to the current frame pointer (replacing the caller's locals), and
+   no frame is pushed -- so new_f returns straight to whoever called the caller (and the caller's reused
+   rest list is given back now) */
+void prepare_tail_call(unsigned long nargs, struct object *new_f) {
+  struct object **values;
+  struct object *rest;
+  struct frame *frame;
+  ufixnum_t from;
+
+  from = DYNAMIC_ARRAY_LENGTH(gis->data_stack) - nargs - 1;
+  nargs = prepare_arguments(nargs, new_f, &rest);
+
+  values = DYNAMIC_ARRAY_VALUES(gis->data_stack);
+  memmove(values + gis->vm.fp, values + from, nargs * sizeof(struct object *));
+  init_locals(new_f, gis->vm.fp, nargs);
+
+  if (gis->vm.frames_length > 0) {
+    frame = &gis->vm.frames[gis->vm.frames_length - 1];
+    if (frame->rest != NIL) free_rest_list(frame->rest);
+    frame->rest = rest;
+  }
+
+  gis->vm.f = new_f;
+  gis->vm.i = 0;
+}
+
+/* calls f with the arguments in the list args (like prepare_arguments, but the rest list is the end of
+   args itself) */
+struct object *call_function(struct object *f, struct object *args) {
+  struct object *cursor;
+  ufixnum_t nargs, nparams, nlocals, fp;
+  struct object *saved_f;
+  ufixnum_t saved_i, saved_fp;
+
+  fp = DYNAMIC_ARRAY_LENGTH(gis->data_stack);
+  nparams = FUNCTION_NARGS(f) + FUNCTION_NOPTIONAL(f);
+  nargs = 0;
+  cursor = args;
+  while (cursor != NIL && (nargs < nparams || FUNCTION_REST(f) == rest_none)) {
+    push(CONS_CAR(cursor));
+    cursor = CONS_CDR(cursor);
+    ++nargs;
+  }
+  if (nargs < FUNCTION_NARGS(f) || nargs > nparams) {
+    printf("Function was given %d, but takes %d.\n", (int)nargs, (int)nparams);
+    print(f);
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  nlocals = nargs;
+  if (FUNCTION_NOPTIONAL(f) > 0 || FUNCTION_REST(f) != rest_none) {
+    for (nlocals = nargs; nlocals < nparams; ++nlocals) push(NIL);
+    if (FUNCTION_REST(f) != rest_none) {
+      push(cursor);
+      ++nlocals;
+    }
+    if (FUNCTION_NOPTIONAL(f) > 0) {
+      push(fixnum(nargs));
+      ++nlocals;
+    }
+  }
+  init_locals(f, fp, nlocals);
+
+  /* save the instruction index, and function */
+  /* if there is anything to return to --
+     if this is a macro that is being called from the top level, there would be nothing to return to. */
+  if (gis->vm.f != NIL) {
+    push_frame(gis->vm.f, gis->vm.i + 1, gis->vm.fp); /* resume at the next instruction */
+  } else {
+    push_frame(NIL, 0, gis->vm.fp);
+  }
+
+  /* start the bytecode interpreter at the first instruction */
+  saved_f = gis->vm.f;
+  saved_i = gis->vm.i;
+  saved_fp = gis->vm.fp;
+  gis->vm.f = f;
+  gis->vm.i = 0;
+  gis->vm.fp = fp;
+  run(gis);
+  /* run leaves the registers at the top level -- restore the caller's */
+  gis->vm.f = saved_f;
+  gis->vm.i = saved_i;
+  gis->vm.fp = saved_fp;
+  return pop(); /* discard the result so it doesn't leak into the data-stack */
+}
+
+/* Numbers
+ * The arithmetic and comparison ops work on any mix of fixnums, ufixnums and flonums. If either
+ * operand is a flonum the math is done with flonums, if both are ufixnums it is done with ufixnums,
+ * and otherwise it is done with fixnums.
+ */
+
+/* gets the type of o, making sure it is a number (name is the op's name -- for the error message) */
+enum object_type number_type_of(char *name, struct object *o) {
+  enum object_type t;
+  t = object_type_of(o);
+  if (t != type_fixnum && t != type_ufixnum && t != type_flonum) {
+    printf("Can only %s numbers (was given a %s).\n", name, type_name_of_cstr(o));
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  return t;
+}
+
+flonum_t number_flonum_value(struct object *o, enum object_type t) {
+  if (t == type_flonum) return FLONUM_VALUE(o);
+  if (t == type_ufixnum) return (flonum_t)UFIXNUM_VALUE(o);
+  return (flonum_t)FIXNUM_VALUE(o);
+}
+
+fixnum_t number_fixnum_value(struct object *o, enum object_type t) {
+  if (t == type_ufixnum) return (fixnum_t)UFIXNUM_VALUE(o);
+  return FIXNUM_VALUE(o);
+}
+
+/* x <op> y, where op is op_add, op_sub, op_mul or op_div */
+struct object *arithmetic(char *name, unsigned char op, struct object *x, struct object *y) {
+  enum object_type tx, ty;
+  flonum_t fx, fy;
+  fixnum_t ix, iy;
+  ufixnum_t ux, uy;
+
+  tx = number_type_of(name, x);
+  ty = number_type_of(name, y);
+  if (tx == type_flonum || ty == type_flonum) {
+    fx = number_flonum_value(x, tx);
+    fy = number_flonum_value(y, ty);
+    switch (op) {
+      case op_add: return flonum(fx + fy);
+      case op_sub: return flonum(fx - fy);
+      case op_mul: return flonum(fx * fy);
+      default: return flonum(fx / fy);
+    }
+  } else if (tx == type_ufixnum && ty == type_ufixnum) {
+    ux = UFIXNUM_VALUE(x);
+    uy = UFIXNUM_VALUE(y);
+    switch (op) {
+      case op_add: return ufixnum(ux + uy);
+      case op_sub: return ufixnum(ux - uy);
+      case op_mul: return ufixnum(ux * uy);
+      default:
+        if (uy == 0) {
+          printf("Division by zero.\n");
+          PRINT_STACK_TRACE_AND_QUIT();
+        }
+        return ufixnum(ux / uy);
+    }
+  }
+  ix = number_fixnum_value(x, tx);
+  iy = number_fixnum_value(y, ty);
+  switch (op) {
+    case op_add: return fixnum(ix + iy);
+    case op_sub: return fixnum(ix - iy);
+    case op_mul: return fixnum(ix * iy);
+    default:
+      if (iy == 0) {
+        printf("Division by zero.\n");
+        PRINT_STACK_TRACE_AND_QUIT();
+      }
+      return fixnum(ix / iy);
+  }
+}
+
+/* x <op> y, where op is op_gt, op_lt, op_gte or op_lte */
+char compare_numbers(char *name, unsigned char op, struct object *x, struct object *y) {
+  enum object_type tx, ty;
+  flonum_t fx, fy;
+  fixnum_t ix, iy;
+  ufixnum_t ux, uy;
+
+  tx = number_type_of(name, x);
+  ty = number_type_of(name, y);
+  if (tx == type_flonum || ty == type_flonum) {
+    fx = number_flonum_value(x, tx);
+    fy = number_flonum_value(y, ty);
+    switch (op) {
+      case op_gt: return fx > fy;
+      case op_lt: return fx < fy;
+      case op_gte: return fx >= fy;
+      default: return fx <= fy;
+    }
+  } else if (tx == type_ufixnum && ty == type_ufixnum) {
+    ux = UFIXNUM_VALUE(x);
+    uy = UFIXNUM_VALUE(y);
+    switch (op) {
+      case op_gt: return ux > uy;
+      case op_lt: return ux < uy;
+      case op_gte: return ux >= uy;
+      default: return ux <= uy;
+    }
+  }
+  ix = number_fixnum_value(x, tx);
+  iy = number_fixnum_value(y, ty);
+  switch (op) {
+    case op_gt: return ix > iy;
+    case op_lt: return ix < iy;
+    case op_gte: return ix >= iy;
+    default: return ix <= iy;
+  }
+}
+
+#ifdef THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic" /* labels as values are a GNU extension (see "Dispatch") */
+#endif
+/* returns the top of the stack for convience */
+  /* evaluates gis->vm.f starting at instruction gis->vm.i */
+  /* assumes gis->vm.i, gis->vm.f and gis->vm.fp are set and the data stack has been initialized with
+   * space for all stack args */
+  struct object *run(struct gis * gis) {
+    uint32_t word; /* the current instruction */
+    unsigned char op;
+    unsigned long a0, a1;  /* the arguments for bytecode parameters */
+    unsigned long a2;
+    unsigned long sa0;               /* argument for jumps (the index of the instruction to jump to) */
+    struct object *v0, *v1; /* temps for values popped off the stack */
+    struct object *c0; /* temps for constants (used for bytecode arguments) */
+    struct object *temp_f;
+    struct object *cursor;
+    /* registers -- copies of gis->vm and the parts of f that are used on every instruction */
+    struct object *f; /* the function being evaluated */
+    ufixnum_t i; /* the index of the current instruction */
+    uint32_t *instructions; /* f's decoded code */
+    ufixnum_t instruction_count;
+    struct dynamic_array *constants; /* the constants array */
+    struct dynamic_array *stack; /* the data stack */
+    struct object **sp, **stack_limit, **locals; /* pointers into the data stack (see "Stack caching") */
+#if defined(JIT) || defined(AOT)
+    struct native_state native_state;
+#endif
+    ufixnum_t fp; /* the index of the current function's first local in the data stack */
+    struct call_cache *call_caches; /* f's inline caches (see struct call_cache) */
+    struct call_cache *cache;
+    struct frame *frame;
+    void *arg_values[MAX_FFI_NARGS]; /* for calling foreign functions */
+    fixnum_t fixnum_values[MAX_FFI_NARGS]; /* storage for fixnum arguments (immediate fixnums have no address) */
+    ffi_sarg sresult;                /* signed result */
+    void *ptr_result;
+#ifdef THREADED_DISPATCH
+    static void *dispatch_table[256]; /* the label of each op -- indexed by op (see TARGET) */
+    static char dispatch_table_initialized = 0;
+
+    if (!dispatch_table_initialized) {
+      for (a0 = 0; a0 < 256; ++a0) dispatch_table[a0] = &&label_default;
+      SET_TARGET(op_drop);
+      SET_TARGET(op_dup);
+      SET_TARGET(op_intern);
+      SET_TARGET(op_cons);
+      SET_TARGET(op_car);
+      SET_TARGET(op_cdr);
+      SET_TARGET(op_add);
+      SET_TARGET(op_addi);
+      SET_TARGET(op_sub);
+      SET_TARGET(op_subi);
+      SET_TARGET(op_mul);
+      SET_TARGET(op_div);
+      SET_TARGET(op_list);
+      SET_TARGET(op_load_nil);
+      SET_TARGET(op_const);
+      SET_TARGET(op_const_0);
+      SET_TARGET(op_const_1);
+      SET_TARGET(op_const_2);
+      SET_TARGET(op_const_3);
+      SET_TARGET(op_push_arg);
+      SET_TARGET(op_push_args);
+      SET_TARGET(op_print);
+      SET_TARGET(op_print_nl);
+      SET_TARGET(op_eq);
+      SET_TARGET(op_and);
+      SET_TARGET(op_or);
+      SET_TARGET(op_gt);
+      SET_TARGET(op_gte);
+      SET_TARGET(op_bin_and);
+      SET_TARGET(op_bin_or);
+      SET_TARGET(op_shift_left);
+      SET_TARGET(op_shift_right);
+      SET_TARGET(op_lt);
+      SET_TARGET(op_lti);
+      SET_TARGET(op_lte);
+      SET_TARGET(op_set_symbol_value);
+      SET_TARGET(op_set_symbol_function);
+      SET_TARGET(op_symbol_value);
+      SET_TARGET(op_symbol_function);
+      SET_TARGET(op_jump_forward);
+      SET_TARGET(op_jump_forward_when_nil);
+      SET_TARGET(op_jump_backward);
+      SET_TARGET(op_load_from_stack);
+      SET_TARGET(op_load_from_stack_0);
+      SET_TARGET(op_load_from_stack_1);
+      SET_TARGET(op_store_to_stack);
+      SET_TARGET(op_store_to_stack_0);
+      SET_TARGET(op_store_to_stack_1);
+      SET_TARGET(op_call_function);
+      SET_TARGET(op_call_symbol_function);
+      SET_TARGET(op_return_function);
+      SET_TARGET(op_alloc_struct);
+      SET_TARGET(op_byte_stream);
+      SET_TARGET(op_byte_stream_peek);
+      SET_TARGET(op_byte_stream_read);
+      SET_TARGET(op_dynamic_array);
+      SET_TARGET(op_dynamic_array_get);
+      SET_TARGET(op_dynamic_array_set);
+      SET_TARGET(op_dynamic_array_length);
+      SET_TARGET(op_dynamic_array_push);
+      SET_TARGET(op_dynamic_array_pop);
+      SET_TARGET(op_dynamic_array_concat);
+      SET_TARGET(op_dynamic_byte_array);
+      SET_TARGET(op_dynamic_byte_array_concat);
+      SET_TARGET(op_dynamic_byte_array_get);
+      SET_TARGET(op_dynamic_byte_array_insert);
+      SET_TARGET(op_dynamic_byte_array_length);
+      SET_TARGET(op_dynamic_byte_array_set);
+      SET_TARGET(op_dynamic_byte_array_push);
+      SET_TARGET(op_dynamic_byte_array_pop);
+      SET_TARGET(op_function_code);
+      SET_TARGET(op_gensym);
+      SET_TARGET(op_string_concat);
+      SET_TARGET(op_struct_field);
+      SET_TARGET(op_to_string);
+      SET_TARGET(op_set_struct_field);
+      SET_TARGET(op_symbol_name);
+      SET_TARGET(op_symbol_type);
+      SET_TARGET(op_type_of);
+      SET_TARGET(op_write_file);
+      SET_TARGET(op_tail_call);
+      SET_TARGET(op_fixnum_add);
+      SET_TARGET(op_fixnum_sub);
+      SET_TARGET(op_fixnum_mul);
+      SET_TARGET(op_fixnum_lt);
+      SET_TARGET(op_fixnum_gt);
+      SET_TARGET(op_fixnum_lte);
+      SET_TARGET(op_fixnum_gte);
+      SET_TARGET(op_fixnum_eq);
+      SET_TARGET(op_unchecked_car);
+      SET_TARGET(op_unchecked_cdr);
+      SET_TARGET(op_make_closure);
+      SET_TARGET(op_load_closure);
+      SET_TARGET(op_store_box);
+      SET_TARGET(op_return_values);
+      SET_TARGET(op_multiple_values);
+      SET_TARGET(op_bind);
+      SET_TARGET(op_unbind);
+      SET_TARGET(op_add_fixnum_fixnum);
+      SET_TARGET(op_sub_fixnum_fixnum);
+      SET_TARGET(op_mul_fixnum_fixnum);
+      SET_TARGET(op_div_fixnum_fixnum);
+      SET_TARGET(op_gt_fixnum_fixnum);
+      SET_TARGET(op_lt_fixnum_fixnum);
+      SET_TARGET(op_gte_fixnum_fixnum);
+      SET_TARGET(op_lte_fixnum_fixnum);
+      SET_TARGET(op_add_flonum_flonum);
+      SET_TARGET(op_sub_flonum_flonum);
+      SET_TARGET(op_mul_flonum_flonum);
+      SET_TARGET(op_div_flonum_flonum);
+      SET_TARGET(op_gt_flonum_flonum);
+      SET_TARGET(op_lt_flonum_flonum);
+      SET_TARGET(op_gte_flonum_flonum);
+      SET_TARGET(op_lte_flonum_flonum);
+      SET_TARGET(op_load_nil_drop);
+      SET_TARGET(op_drop_load_from_stack);
+      SET_TARGET(op_load_from_stack_load_from_stack);
+      SET_TARGET(op_load_from_stack_const);
+      SET_TARGET(op_load_from_stack_jump_forward_when_nil);
+      SET_TARGET(op_lt_jump_forward_when_nil);
+      SET_TARGET(op_fixnum_lt_jump_forward_when_nil);
+#ifdef REGISTERS
+      SET_TARGET(op_registers);
+#endif
+      dispatch_table_initialized = 1;
+    }
+#endif
+
+    /* jump to eval_restart after setting a new i and f
+       (and pushing the old i and bc to the call-stack) */
+
+    f = gis->vm.f;
+    i = gis->vm.i;
+
+  eval_restart: /* f and i have been set to a new function (and its frame is at the top of the call-stack) */
+    gis->vm.f = f;
+    stack = gis->data_stack->w1.value.dynamic_array;
+    fp = gis->vm.fp;
+    LOAD_STACK();
+    if (FUNCTION_INSTRUCTIONS(f) == NULL) decode_function(f);
+    else if (i == 0 && FUNCTION_CODE_VERSION(f) != DYNAMIC_BYTE_ARRAY_VERSION(FUNCTION_CODE(f))) redecode_function(f);
+    ENSURE_STACK_ROOM(FUNCTION_MAX_DEPTH(f));
+    instructions = FUNCTION_INSTRUCTIONS(f);
+    instruction_count = FUNCTION_INSTRUCTION_COUNT(f);
+    call_caches = FUNCTION_CALL_CACHES(f);
+    constants = FUNCTION_CONSTANTS(f)->w1.value.dynamic_array;
+#ifdef AOT
+    if (FUNCTION_AOT(f) != NULL) ENTER_AOT();
+#endif
+#ifdef JIT
+    if (i == 0) WARM_JIT();
+    if (FUNCTION_JIT(f) != NULL) ENTER_JIT();
+#endif
+
+    while (i < instruction_count) {
+      word = instructions[i];
+      op = INSTRUCTION_OP(word);
+      PROFILE_OP();
+      switch (op) {
+        TARGET(op_drop): /* drop ( x -- ) */
+          --sp;
+          NEXT();
+        TARGET(op_dup): /* dup ( x -- x x ) */
+          v0 = STACK_I(0);
+          PUSH(v0);
+          NEXT();
+        TARGET(op_cons): /* cons ( car cdr -- (cons car cdr) ) */
+          v1 = POP(); /* cdr */
+          v0 = STACK_I(0); /* car */
+          STACK_I(0) = cons(v0, v1);
+          NEXT();
+        TARGET(op_intern): /* intern ( string -- symbol ) */
+          v0 = STACK_I(0);
+          printf("op_intern is not implemented.");
+          PRINT_STACK_TRACE_AND_QUIT();
+          OT("intern", 0, v0, type_string);
+          STACK_I(0) = intern(STACK_I(0), NIL);
+          NEXT();
+        TARGET(op_car): /* car ( (cons car cdr) -- car ) */
+          v0 = STACK_I(0);
+          if (v0 == NIL) {
+            STACK_I(0) = NIL;
+          } else if (type_of(v0) == gis->cons_type) {
+            STACK_I(0) = CONS_CAR(v0);
+          } else {
+            printf("Can only car a list (was given a %s).\n",
+                   type_name_of_cstr(v0));
+            PRINT_STACK_TRACE_AND_QUIT();
+          }
+          NEXT();
+        TARGET(op_cdr): /* cdr ( (cons car cdr) -- cdr ) */
+          v0 = STACK_I(0);
+          if (v0 == NIL) {
+            STACK_I(0) = NIL;
+          } else if (type_of(v0) == gis->cons_type) {
+            STACK_I(0) = CONS_CDR(v0);
+          } else {
+            printf("Can only cdr a list (was given a %s).\n",
+                   type_name_of_cstr(v0));
+            PRINT_STACK_TRACE_AND_QUIT();
+          }
+          NEXT();
+        TARGET(op_unchecked_car): /* unchecked-car ( list -- car ) -- list isn't checked (see op_fixnum_add) */
+          if (STACK_I(0) != NIL) STACK_I(0) = CONS_CAR(STACK_I(0));
+          NEXT();
+        TARGET(op_unchecked_cdr): /* unchecked-cdr ( list -- cdr ) */
+          if (STACK_I(0) != NIL) STACK_I(0) = CONS_CDR(STACK_I(0));
+          NEXT();
+        TARGET(op_make_closure): /* make-closure <n> ( template x_0...x_n -- closure ) */
+          READ_OP_ARG();
+          v0 = make_closure(STACK_I(a0), sp - a0, a0);
+          sp -= a0;
+          STACK_I(0) = v0;
+          NEXT();
+        TARGET(op_load_closure): /* load-closure <n> ( -- x ) -- the nth value f's closure has */
+          READ_OP_ARG();
+          if (FUNCTION_CLOSURE(f) == NIL || a0 >= DYNAMIC_ARRAY_LENGTH(FUNCTION_CLOSURE(f))) {
+            printf("BC: load-closure %lu in a function that isn't a closure with that many values.\n",
+                   (unsigned long)a0);
+            PRINT_STACK_TRACE_AND_QUIT();
+          }
+          PUSH(DYNAMIC_ARRAY_VALUES(FUNCTION_CLOSURE(f))[a0]);
+          NEXT();
+        TARGET(op_store_box): /* store-box ( x box -- ) -- sets the box's value (its car) to x */
+          v1 = POP(); /* box */
+          CONS_CAR(v1) = POP();
+          NEXT();
+        TARGET(op_multiple_values): /* multiple-values <n> ( x -- x_1...x_n ) -- the first n values of the call
+                                       that just returned x (nil for the ones it didn't return) */
+          READ_OP_ARG();
+          for (a1 = 1; a1 < a0; ++a1) PUSH(a1 < gis->vm.nvalues ? gis->vm.values[a1 - 1] : NIL);
+          NEXT();
+        TARGET(op_bind): /* bind ( value sym -- ) -- sym's value is value until the unbind that ends the let */
+          v1 = POP(); /* sym */
+          bind_special(v1, POP());
+          NEXT();
+        TARGET(op_unbind): /* unbind <n> ( -- ) -- gives back the values the last n binds replaced */
+          READ_OP_ARG();
+          unbind_specials(a0);
+          NEXT();
+        TARGET(op_gt): /* gt ( x y -- x>y ) */
+          v1 = POP(); /* y */
+          QUICKEN(op_gt_fixnum_fixnum, op_gt_flonum_flonum, STACK_I(0), v1);
+          STACK_I(0) = compare_numbers("compare", op_gt, STACK_I(0), v1) ? T : NIL;
+          NEXT();
+        TARGET(op_lt): /* lt ( x y -- x<y ) */
+          v1 = POP(); /* y */
+          QUICKEN(op_lt_fixnum_fixnum, op_lt_flonum_flonum, STACK_I(0), v1);
+          STACK_I(0) = compare_numbers("compare", op_lt, STACK_I(0), v1) ? T : NIL;
+          NEXT();
+        TARGET(op_lti): /* lti <n> ( x -- x<n ) */
+          READ_OP_ARG();
+          STACK_I(0) = (IS_IMMEDIATE_FIXNUM(STACK_I(0)) ? IMMEDIATE_FIXNUM_VALUE(STACK_I(0)) < (fixnum_t)a0
+                                                        : compare_numbers("compare", op_lt, STACK_I(0), fixnum(a0)))
+                           ? T
+                           : NIL;
+          NEXT();
+        TARGET(op_gte): /* gte ( x y -- x>=y ) */
+          v1 = POP(); /* y */
+          QUICKEN(op_gte_fixnum_fixnum, op_gte_flonum_flonum, STACK_I(0), v1);
+          STACK_I(0) = compare_numbers("compare", op_gte, STACK_I(0), v1) ? T : NIL;
+          NEXT();
+        TARGET(op_lte): /* gte ( x y -- x<=y ) */
+          v1 = POP(); /* y */
+          QUICKEN(op_lte_fixnum_fixnum, op_lte_flonum_flonum, STACK_I(0), v1);
+          STACK_I(0) = compare_numbers("compare", op_lte, STACK_I(0), v1) ? T : NIL;
+          NEXT();
+        TARGET(op_bin_or): /* bin-or ( x y -- x|y ) */
+          v1 = POP(); /* y */
+          CHECK_FIXNUMS("|", STACK_I(0), v1);
+          STACK_I(0) = fixnum(FIXNUM_VALUE(STACK_I(0)) | FIXNUM_VALUE(v1));
+          NEXT();
+        TARGET(op_bin_and): /* bin-and ( x y -- x&y ) */
+          v1 = POP(); /* y */
+          CHECK_FIXNUMS("&", STACK_I(0), v1);
+          STACK_I(0) = fixnum(FIXNUM_VALUE(STACK_I(0)) & FIXNUM_VALUE(v1));
+          NEXT();
+        TARGET(op_shift_right): /* shift-right ( x y -- x>>y ) */
+          v1 = POP(); /* y */
+          CHECK_FIXNUMS(">>", STACK_I(0), v1);
+          STACK_I(0) = fixnum(FIXNUM_VALUE(STACK_I(0)) >> FIXNUM_VALUE(v1));
+          NEXT();
+        TARGET(op_shift_left): /* shift-left ( x y -- x<<y ) */
+          v1 = POP(); /* y */
+          CHECK_FIXNUMS("<<", STACK_I(0), v1);
+          STACK_I(0) = fixnum(FIXNUM_VALUE(STACK_I(0)) << FIXNUM_VALUE(v1));
+          NEXT();
+        TARGET(op_add): /* add ( x y -- x+y ) */
+          v1 = POP(); /* y */
+          QUICKEN(op_add_fixnum_fixnum, op_add_flonum_flonum, STACK_I(0), v1);
+          STACK_I(0) = arithmetic("add", op_add, STACK_I(0), v1);
+          NEXT();
+        TARGET(op_addi): /* addi <n> ( x -- x+n ) */
+          READ_OP_ARG();
+          STACK_I(0) = IS_IMMEDIATE_FIXNUM(STACK_I(0)) ? fixnum(IMMEDIATE_FIXNUM_VALUE(STACK_I(0)) + (fixnum_t)a0)
+                                                       : arithmetic("add", op_add, STACK_I(0), fixnum(a0));
+          NEXT();
+        TARGET(op_subi): /* subi <n> ( x -- x-n ) */
+          READ_OP_ARG();
+          STACK_I(0) = IS_IMMEDIATE_FIXNUM(STACK_I(0)) ? fixnum(IMMEDIATE_FIXNUM_VALUE(STACK_I(0)) - (fixnum_t)a0)
+                                                       : arithmetic("subtract", op_sub, STACK_I(0), fixnum(a0));
+          NEXT();
+        TARGET(op_sub): /* sub ( x y -- x-y ) */
+          v1 = POP(); /* y */
+          QUICKEN(op_sub_fixnum_fixnum, op_sub_flonum_flonum, STACK_I(0), v1);
+          STACK_I(0) = arithmetic("subtract", op_sub, STACK_I(0), v1);
+          NEXT();
+        TARGET(op_mul): /* mul ( x y -- x*y ) */
+          v1 = POP(); /* y */
+          QUICKEN(op_mul_fixnum_fixnum, op_mul_flonum_flonum, STACK_I(0), v1);
+          STACK_I(0) = arithmetic("multiply", op_mul, STACK_I(0), v1);
+          NEXT();
+        TARGET(op_div): /* div ( x y -- x/y ) */
+          v1 = POP(); /* y */
+          QUICKEN(op_div_fixnum_fixnum, op_div_flonum_flonum, STACK_I(0), v1);
+          STACK_I(0) = arithmetic("divide", op_div, STACK_I(0), v1);
+          NEXT();
+        /* the fixnum ops are only in functions declared (optimize (safety 0)), where the compiler knows both
+           operands are fixnums -- so their types aren't checked (but they can still be boxed) */
+        TARGET(op_fixnum_add): /* fixnum-add ( x y -- x+y ) */
+          v1 = POP(); /* y */
+          STACK_I(0) = fixnum(FIXNUM_VALUE(STACK_I(0)) + FIXNUM_VALUE(v1));
+          NEXT();
+        TARGET(op_fixnum_sub): /* fixnum-sub ( x y -- x-y ) */
+          v1 = POP(); /* y */
+          STACK_I(0) = fixnum(FIXNUM_VALUE(STACK_I(0)) - FIXNUM_VALUE(v1));
+          NEXT();
+        TARGET(op_fixnum_mul): /* fixnum-mul ( x y -- x*y ) */
+          v1 = POP(); /* y */
+          STACK_I(0) = fixnum(FIXNUM_VALUE(STACK_I(0)) * FIXNUM_VALUE(v1));
+          NEXT();
+        TARGET(op_fixnum_lt): /* fixnum-lt ( x y -- x<y ) */
+          v1 = POP(); /* y */
+          STACK_I(0) = FIXNUM_VALUE(STACK_I(0)) < FIXNUM_VALUE(v1) ? T : NIL;
+          NEXT();
+        TARGET(op_fixnum_gt): /* fixnum-gt ( x y -- x>y ) */
+          v1 = POP(); /* y */
+          STACK_I(0) = FIXNUM_VALUE(STACK_I(0)) > FIXNUM_VALUE(v1) ? T : NIL;
+          NEXT();
+        TARGET(op_fixnum_lte): /* fixnum-lte ( x y -- x<=y ) */
+          v1 = POP(); /* y */
+          STACK_I(0) = FIXNUM_VALUE(STACK_I(0)) <= FIXNUM_VALUE(v1) ? T : NIL;
+          NEXT();
+        TARGET(op_fixnum_gte): /* fixnum-gte ( x y -- x>=y ) */
+          v1 = POP(); /* y */
+          STACK_I(0) = FIXNUM_VALUE(STACK_I(0)) >= FIXNUM_VALUE(v1) ? T : NIL;
+          NEXT();
+        TARGET(op_fixnum_eq): /* fixnum-eq ( x y -- x=y ) */
+          v1 = POP(); /* y */
+          STACK_I(0) = FIXNUM_VALUE(STACK_I(0)) == FIXNUM_VALUE(v1) ? T : NIL;
+          NEXT();
+        TARGET(op_add_fixnum_fixnum): /* add for two immediate fixnums (see QUICKEN) */
+          if (!BOTH_FIXNUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_add);
+          v1 = POP(); /* y */
+          STACK_I(0) = fixnum(IMMEDIATE_FIXNUM_VALUE(STACK_I(0)) + IMMEDIATE_FIXNUM_VALUE(v1));
+          NEXT();
+        TARGET(op_sub_fixnum_fixnum): /* sub for two immediate fixnums (see QUICKEN) */
+          if (!BOTH_FIXNUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_sub);
+          v1 = POP(); /* y */
+          STACK_I(0) = fixnum(IMMEDIATE_FIXNUM_VALUE(STACK_I(0)) - IMMEDIATE_FIXNUM_VALUE(v1));
+          NEXT();
+        TARGET(op_mul_fixnum_fixnum): /* mul for two immediate fixnums (see QUICKEN) */
+          if (!BOTH_FIXNUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_mul);
+          v1 = POP(); /* y */
+          STACK_I(0) = fixnum(IMMEDIATE_FIXNUM_VALUE(STACK_I(0)) * IMMEDIATE_FIXNUM_VALUE(v1));
+          NEXT();
+        TARGET(op_div_fixnum_fixnum): /* div for two immediate fixnums (see QUICKEN) */
+          if (!BOTH_FIXNUMS(STACK_I(1), STACK_I(0)) || STACK_I(0) == IMMEDIATE_FIXNUM(0)) DEQUICKEN(op_div);
+          v1 = POP(); /* y */
+          STACK_I(0) = fixnum(IMMEDIATE_FIXNUM_VALUE(STACK_I(0)) / IMMEDIATE_FIXNUM_VALUE(v1));
+          NEXT();
+        TARGET(op_gt_fixnum_fixnum): /* gt for two immediate fixnums -- tagging keeps their order */
+          if (!BOTH_FIXNUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_gt);
+          v1 = POP(); /* y */
+          STACK_I(0) = (intptr_t)STACK_I(0) > (intptr_t)v1 ? T : NIL;
+          NEXT();
+        TARGET(op_lt_fixnum_fixnum): /* lt for two immediate fixnums -- tagging keeps their order */
+          if (!BOTH_FIXNUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_lt);
+          v1 = POP(); /* y */
+          STACK_I(0) = (intptr_t)STACK_I(0) < (intptr_t)v1 ? T : NIL;
+          NEXT();
+        TARGET(op_gte_fixnum_fixnum): /* gte for two immediate fixnums -- tagging keeps their order */
+          if (!BOTH_FIXNUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_gte);
+          v1 = POP(); /* y */
+          STACK_I(0) = (intptr_t)STACK_I(0) >= (intptr_t)v1 ? T : NIL;
+          NEXT();
+        TARGET(op_lte_fixnum_fixnum): /* lte for two immediate fixnums -- tagging keeps their order */
+          if (!BOTH_FIXNUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_lte);
+          v1 = POP(); /* y */
+          STACK_I(0) = (intptr_t)STACK_I(0) <= (intptr_t)v1 ? T : NIL;
+          NEXT();
+        TARGET(op_add_flonum_flonum): /* add for two flonums (see QUICKEN) */
+          if (!BOTH_FLONUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_add);
+          v1 = POP(); /* y */
+          STACK_I(0) = flonum(FLONUM_VALUE(STACK_I(0)) + FLONUM_VALUE(v1));
+          NEXT();
+        TARGET(op_sub_flonum_flonum): /* sub for two flonums (see QUICKEN) */
+          if (!BOTH_FLONUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_sub);
+          v1 = POP(); /* y */
+          STACK_I(0) = flonum(FLONUM_VALUE(STACK_I(0)) - FLONUM_VALUE(v1));
+          NEXT();
+        TARGET(op_mul_flonum_flonum): /* mul for two flonums (see QUICKEN) */
+          if (!BOTH_FLONUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_mul);
+          v1 = POP(); /* y */
+          STACK_I(0) = flonum(FLONUM_VALUE(STACK_I(0)) * FLONUM_VALUE(v1));
+          NEXT();
+        TARGET(op_div_flonum_flonum): /* div for two flonums (see QUICKEN) */
+          if (!BOTH_FLONUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_div);
+          v1 = POP(); /* y */
+          STACK_I(0) = flonum(FLONUM_VALUE(STACK_I(0)) / FLONUM_VALUE(v1));
+          NEXT();
+        TARGET(op_gt_flonum_flonum): /* gt for two flonums (see QUICKEN) */
+          if (!BOTH_FLONUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_gt);
+          v1 = POP(); /* y */
+          STACK_I(0) = FLONUM_VALUE(STACK_I(0)) > FLONUM_VALUE(v1) ? T : NIL;
+          NEXT();
+        TARGET(op_lt_flonum_flonum): /* lt for two flonums (see QUICKEN) */
+          if (!BOTH_FLONUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_lt);
+          v1 = POP(); /* y */
+          STACK_I(0) = FLONUM_VALUE(STACK_I(0)) < FLONUM_VALUE(v1) ? T : NIL;
+          NEXT();
+        TARGET(op_gte_flonum_flonum): /* gte for two flonums (see QUICKEN) */
+          if (!BOTH_FLONUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_gte);
+          v1 = POP(); /* y */
+          STACK_I(0) = FLONUM_VALUE(STACK_I(0)) >= FLONUM_VALUE(v1) ? T : NIL;
+          NEXT();
+        TARGET(op_lte_flonum_flonum): /* lte for two flonums (see QUICKEN) */
+          if (!BOTH_FLONUMS(STACK_I(1), STACK_I(0))) DEQUICKEN(op_lte);
+          v1 = POP(); /* y */
+          STACK_I(0) = FLONUM_VALUE(STACK_I(0)) <= FLONUM_VALUE(v1) ? T : NIL;
+          NEXT();
+        /* superinstructions (see fuse_superinstructions) -- the second op's instruction is at i + 1 */
+        TARGET(op_load_nil_drop): /* load-nil drop ( -- ) */
+          ++i;
+          NEXT();
+        TARGET(op_drop_load_from_stack): /* drop load-from-stack <n> ( x -- local_n ) */
+          STACK_I(0) = LOCAL(INSTRUCTION_ARG(instructions[++i]));
+          NEXT();
+        TARGET(op_load_from_stack_load_from_stack): /* load-from-stack <n> load-from-stack <m> ( -- local_n local_m ) */
+          READ_OP_ARG();
+          PUSH(LOCAL(a0));
+          PUSH(LOCAL(INSTRUCTION_ARG(instructions[++i])));
+          NEXT();
+        TARGET(op_load_from_stack_const): /* load-from-stack <n> const <m> ( -- local_n constant_m ) */
+          READ_OP_ARG();
+          PUSH(LOCAL(a0));
+          PUSH(constants->values[INSTRUCTION_ARG(instructions[++i])]);
+          NEXT();
+        TARGET(op_load_from_stack_jump_forward_when_nil): /* load-from-stack <n> jump-forward-when-nil ( -- ) */
+          READ_OP_ARG();
+          if (LOCAL(a0) == NIL)
+            i = INSTRUCTION_ARG(instructions[i + 1]);
+          else
+            i += 2;
+          DISPATCH();
+        TARGET(op_lt_jump_forward_when_nil): /* lt jump-forward-when-nil ( x y -- ) */
+          v1 = POP(); /* y */
+          v0 = POP(); /* x */
+          if (BOTH_FIXNUMS(v0, v1) ? (intptr_t)v0 < (intptr_t)v1 : compare_numbers("compare", op_lt, v0, v1))
+            i += 2;
+          else
+            i = INSTRUCTION_ARG(instructions[i + 1]);
+          DISPATCH();
+        TARGET(op_fixnum_lt_jump_forward_when_nil): /* fixnum-lt jump-forward-when-nil ( x y -- ) */
+          v1 = POP(); /* y */
+          v0 = POP(); /* x */
+          if (FIXNUM_VALUE(v0) < FIXNUM_VALUE(v1))
+            i += 2;
+          else
+            i = INSTRUCTION_ARG(instructions[i + 1]);
+          DISPATCH();
+        TARGET(op_eq): /* eq ( x y -- z ) */
+          v1 = POP(); /* y */
+          /* TODO: add t */
+          STACK_I(0) = equals(STACK_I(0), v1) ? gis->type_t_sym : NIL;
+          NEXT();
+        TARGET(op_and): /* and ( x y -- z ) */
+          v1 = POP(); /* y */
+          if (STACK_I(0) != NIL && v1 != NIL)
+            STACK_I(0) = v1;
+          else
+            STACK_I(0) = NIL;
+          NEXT();
+        TARGET(op_list): /* list <n> ( ...n... -- ) */
+          READ_OP_ARG();
+          if (a0 == 0) {
+            PUSH(NIL);
+          } else if (a0 == 1)
+            STACK_I(0) = cons(STACK_I(0), NIL);
+          else {
+            STACK_I(0) = cons(STACK_I(0), NIL);
+            for (a1 = 1; a1 < a0; ++a1)
+              STACK_I(0) = cons(STACK_I(a1), STACK_I(0));
+            /* set the earliest stack item to be the result, because so we can
              * simply update the data stack's count to pop the args */
             STACK_I(a0 - 1) = STACK_I(0);
-            gis->data_stack->w1.value.dynamic_array->length -= a0 - 1;
+            sp -= a0 - 1;
           }
-          break;
-        case op_or: /* or ( x y -- z ) */
-          SC("or", 2);
-          v1 = pop(); /* y */
+          NEXT();
+        TARGET(op_or): /* or ( x y -- z ) */
+          v1 = POP(); /* y */
           if (STACK_I(0) != NIL && v1 != NIL) {
             STACK_I(0) = v1;
           } else if (STACK_I(0) != NIL) {
@@ -2099,111 +4305,104 @@ struct object *call_function(struct object *f, struct object *args) {
           } else {
             STACK_I(0) = NIL;
           }
-          break;
-        case op_load_nil:
-          push(NIL);
-          break;
-        case op_const_0:
-#ifdef RUN_TIME_CHECKS
-        if (constants->length < 1) {
-          printf("Out of bounds of constants vector.");
-          PRINT_STACK_TRACE_AND_QUIT();
-        }
-#endif
-        push(constants->values[0]);
-        break;
-      case op_const_1:
-#ifdef RUN_TIME_CHECKS
-        if (constants->length < 2) {
-          printf("Out of bounds of constants vector.");
-          PRINT_STACK_TRACE_AND_QUIT();
-        }
-#endif
-        push(constants->values[1]);
-        break;
-      case op_const_2:
-#ifdef RUN_TIME_CHECKS
-        if (constants->length < 3) {
-          printf("Out of bounds of constants vector.");
-          PRINT_STACK_TRACE_AND_QUIT();
-        }
-#endif
-        push(constants->values[2]);
-        break;
-      case op_const_3:
-#ifdef RUN_TIME_CHECKS
-        if (constants->length < 4) {
-          printf("Out of bounds of constants vector.");
-          PRINT_STACK_TRACE_AND_QUIT();
-        }
-#endif
-        push(constants->values[3]);
-        break;
-      case op_const: /* const ( -- x ) */
+          NEXT();
+        TARGET(op_load_nil):
+          PUSH(NIL);
+          NEXT();
+        TARGET(op_const_0):
+        PUSH(constants->values[0]);
+        NEXT();
+      TARGET(op_const_1):
+        PUSH(constants->values[1]);
+        NEXT();
+      TARGET(op_const_2):
+        PUSH(constants->values[2]);
+        NEXT();
+      TARGET(op_const_3):
+        PUSH(constants->values[3]);
+        NEXT();
+      TARGET(op_const): /* const ( -- x ) */
         READ_CONST_ARG();
-        push(c0);
-        break;
-      case op_push_arg: /* push-arg ( x -- ) */
-        dynamic_array_push(gis->call_stack, pop());
-        break;
-      case op_push_args: /* push-args <n> ( x_0...x_n -- ) */
+        PUSH(c0);
+        NEXT();
+      TARGET(op_push_arg): /* push-arg ( x -- ) */
+        /* arguments are passed on the data stack -- they are already where they need to be */
+        NEXT();
+      TARGET(op_push_args): /* push-args <n> ( x_0...x_n -- ) */
         READ_OP_ARG();
-        for (a1 = 0; a1 < a0; ++a1) dynamic_array_push(gis->call_stack, pop());
-        break;
-      case op_load_from_stack: /* load-from-stack ( -- ) */
+        /* arguments are passed on the data stack -- they are already where they need to be */
+        NEXT();
+      TARGET(op_load_from_stack): /* load-from-stack ( -- ) */
         READ_OP_ARG();
-        /* minus two to skip the f and i */
-        push(GET_LOCAL(a0));
-        break;
+        PUSH(LOCAL(a0));
+        NEXT();
       /* two hard coded index versions for the most common cases (functions that
        * take one or two arguments) */
-      case op_load_from_stack_0:
-        /* minus two to skip the f and i */
-        push(GET_LOCAL(0));
-        break;
-      case op_load_from_stack_1:
-        /* minus two to skip the f and i */
-        push(GET_LOCAL(1));
-        break;
-      case op_store_to_stack: /* store-to-stack ( -- ) */
-        SC("store-to-stack", 1);
+      TARGET(op_load_from_stack_0):
+        PUSH(LOCAL(0));
+        NEXT();
+      TARGET(op_load_from_stack_1):
+        PUSH(LOCAL(1));
+        NEXT();
+      TARGET(op_store_to_stack): /* store-to-stack ( -- ) */
         READ_OP_ARG();
-        SET_LOCAL(a0, pop());
-        break;
+        LOCAL(a0) = POP();
+        NEXT();
       /* two hard coded index versions for the most common cases (functions that
        * take one or two arguments) */
-      case op_store_to_stack_0:
-        SET_LOCAL(0, pop());
-        break;
-      case op_store_to_stack_1:
-        SET_LOCAL(1, pop());
-        break;
+      TARGET(op_store_to_stack_0):
+        LOCAL(0) = POP();
+        NEXT();
+      TARGET(op_store_to_stack_1):
+        LOCAL(1) = POP();
+        NEXT();
       /* this could be specified as  */
       /* TODO; this doesn't need to be its own op, we can tell by the argumen
        * type */
-      case op_call_symbol_function: /* an optimization for calling a function
+      TARGET(op_call_symbol_function): /* an optimization for calling a function
                                        given a symbol */
-      case op_call_function: /* call-function <n> ( arg_0...arg_n fun -- ) */
+      TARGET(op_call_function): /* call-function <n> ( arg_0...arg_n fun -- ) */
+      TARGET(op_tail_call): /* tail-call <n> ( arg_0...arg_n fun -- ) -- a call whose result is
+                               returned right away, so it reuses the current frame */
         READ_OP_ARG();
-        SC("call_function", a0);
-        temp_i = i;
-        temp_f = f;
-        /* set the new function */
+        /* if this call site called the same thing last time, and no symbol's function has changed
+           since then, its cache already knows which function to call and how to call it */
+        cache = &call_caches[i];
+        if (cache->callee == STACK_I(0) && cache->epoch == gis->function_epoch) {
+          temp_f = cache->target;
+          goto call_cached_target;
+        }
+
+        /* the function being called */
         if (op == op_call_symbol_function) {
-          f = symbol_get_function(STACK_I(0));
+          temp_f = symbol_get_function(STACK_I(0));
         } else {
-          f = STACK_I(0);
+          temp_f = STACK_I(0);
         }
 
         /* experimental -- what if any given symbol we just attempt to get the function? */
-        if (type_of(f) == gis->symbol_type) {
-          f = symbol_get_function(STACK_I(0));
+        if (type_of(temp_f) == gis->symbol_type) {
+          temp_f = symbol_get_function(STACK_I(0));
+        }
+
+        if (type_of(temp_f) == gis->foreign_function_type) {
+          cache->kind = call_target_ffi;
+        } else if (type_of(temp_f) != gis->function_type) {
+          printf("Attempted to call a non-function object.\n");
+          print(type_of(temp_f));
+          PRINT_STACK_TRACE_AND_QUIT();
+        } else {
+          cache->kind = FUNCTION_IS_BUILTIN(temp_f) ? call_target_builtin : call_target_bytecode;
         }
+        cache->callee = STACK_I(0);
+        cache->target = temp_f;
+        cache->epoch = gis->function_epoch;
 
+      call_cached_target:
         /* if this is a foreign function */
-        if (type_of(f) == gis->foreign_function_type) {
-          cursor = FFUN_PARAM_TYPES(f);
-          if (a0 > FFUN_NARGS(f)) {
+        if (cache->kind == call_target_ffi) {
+          cursor = FFUN_PARAM_TYPES(temp_f);
+          if (a0 > FFUN_NARGS(temp_f)) {
             printf("Insufficient arguments were passed to foreign function.");
             PRINT_STACK_TRACE_AND_QUIT();
           }
@@ -2216,7 +4415,8 @@ struct object *call_function(struct object *f, struct object *args) {
             } else if (STACK_I(a1) == NIL) {
               arg_values[a2] = &ffi_null;
             } else if (type_of(STACK_I(a1)) == gis->fixnum_type) {
-              arg_values[a2] = &FIXNUM_VALUE(STACK_I(a1));
+              fixnum_values[a2] = FIXNUM_VALUE(STACK_I(a1));
+              arg_values[a2] = &fixnum_values[a2];
             } else if (type_of(STACK_I(a1)) == gis->string_type) {
               dynamic_byte_array_force_cstr(STACK_I(a1));
               arg_values[a2] = &DYNAMIC_BYTE_ARRAY_BYTES(STACK_I(a1));
@@ -2235,68 +4435,85 @@ struct object *call_function(struct object *f, struct object *args) {
 
           /* remove all arguments and the function from the data stack at once
            */
-          DYNAMIC_ARRAY_LENGTH(gis->data_stack) -= a0 + 1;
-
-          if (FFUN_RET_TYPE(f) == gis->pointer_type) {
-            ffi_call(FFUN_CIF(f), FFI_FN(FFUN_PTR(f)), &ptr_result, arg_values);
-            push(pointer(ptr_result));
-          } else if (FFUN_RET_TYPE(f) == gis->string_type) {
-            ffi_call(FFUN_CIF(f), FFI_FN(FFUN_PTR(f)), &ptr_result, arg_values);
-            push(string(ptr_result));
+          sp -= a0 + 1;
+
+          if (FFUN_RET_TYPE(temp_f) == gis->pointer_type) {
+            ffi_call(FFUN_CIF(temp_f), FFI_FN(FFUN_PTR(temp_f)), &ptr_result, arg_values);
+            PUSH(pointer(ptr_result));
+          } else if (FFUN_RET_TYPE(temp_f) == gis->string_type) {
+            ffi_call(FFUN_CIF(temp_f), FFI_FN(FFUN_PTR(temp_f)), &ptr_result, arg_values);
+            PUSH(string(ptr_result));
           } else {
-            ffi_call(FFUN_CIF(f), FFI_FN(FFUN_PTR(f)), &sresult, arg_values);
-            push(fixnum(sresult));
+            ffi_call(FFUN_CIF(temp_f), FFI_FN(FFUN_PTR(temp_f)), &sresult, arg_values);
+            PUSH(fixnum(sresult));
           }
+          gis->vm.nvalues = 1;
 
-          UFIXNUM_VALUE(i) += 1; /* advance to the next instruction */
-          goto eval_restart;     /* restart the evaluation loop */
-        } else if (type_of(f) != gis->function_type) {
-          printf("Attempted to call a non-function object.\n");
-          print(type_of(f));
-          PRINT_STACK_TRACE_AND_QUIT();
+          NEXT(); /* the call-stack wasn't touched, so continue with the next instruction */
         }
 
 #if FUNCTION_TRACE
         if (gis->loaded_core) {
           printf("=== CALL FUNCTION ===\n");
-          print(f);
+          print(temp_f);
         }
 #endif
 
-        prepare_function_call(a0, temp_f, temp_i, f);
+        SAVE_STACK();
+        if (op == op_tail_call) {
+          prepare_tail_call(a0, temp_f);
+        } else {
+          prepare_function_call(a0, f, i, temp_f);
+        }
+        f = temp_f;
 
 #if FUNCTION_TRACE
         if (gis->loaded_core) {
-          print(gis->call_stack);
+          print(gis->data_stack);
           printf("=====================\n");
         }
 #endif
 
-        if (FUNCTION_IS_BUILTIN(f)) {
-          symbol_set_value(
-              gis->impl_i_sym,
-              NIL); /* a NIL instruction index -- for consistency gis->i of NIL
-                       should be set for all builtins */
+        if (cache->kind == call_target_builtin) {
           eval_builtin(f);
+          fp = gis->vm.fp;
+          LOAD_STACK();
           goto return_function_label; /* return */
         } else {
+          i = 0;
           goto eval_restart;            /* restart the evaluation loop */
         }
-      case op_return_function: /* return-function ( x -- ) */
-      return_function_label:
+      TARGET(op_return_values): /* return-values <n> ( x_1...x_n -- ) -- returns x_1 (nil if n is 0), with
+                                   x_2...x_n as its other values */
+        READ_OP_ARG();
+        gis->vm.nvalues = a0;
+        for (a1 = 1; a1 < a0; ++a1) gis->vm.values[a1 - 1] = STACK_I(a0 - 1 - a1);
+        if (a0 == 0) {
+          PUSH(NIL);
+        } else {
+          sp -= a0 - 1;
+        }
+        goto return_function_label;
+      TARGET(op_return_function): /* return-function ( x -- ) */
+        gis->vm.nvalues = 1;
+      return_function_label: /* (builtins return here -- see eval_builtin) */
 #ifdef RUN_TIME_CHECKS
-        if (DYNAMIC_ARRAY_LENGTH(gis->call_stack) == FUNCTION_STACK_SIZE(f)) {
+        if (gis->vm.frames_length == 0) {
           printf("Attempted to return from top-level.");
           PRINT_STACK_TRACE_AND_QUIT();
         }
 #endif
-
-          ufix0 = FUNCTION_STACK_SIZE(f) + 2;
+        /* replace the function's locals (and anything above them) with the return value */
+        LOCAL(0) = STACK_I(0);
+        sp = locals + 1;
+        SAVE_STACK();
+        frame = &gis->vm.frames[--gis->vm.frames_length];
+        if (frame->rest != NIL) free_rest_list(frame->rest);
+        gis->vm.fp = frame->fp;
         /* this indicates that we returned to the top level -- used when calling functions during compile time (starts with macros) */
-        if (DYNAMIC_ARRAY_VALUES(gis->call_stack)[DYNAMIC_ARRAY_LENGTH(gis->call_stack) - 1] == NIL) {
-          DYNAMIC_ARRAY_LENGTH(gis->call_stack) -= ufix0;
-          symbol_set_value(gis->impl_f_sym, NIL);
-          symbol_set_value(gis->impl_i_sym, ufixnum(0)); /* TODO: reuse fixnums so one is not created between call_function calls */
+        if (frame->f == NIL) {
+          gis->vm.f = NIL;
+          gis->vm.i = 0;
           goto quit_run;
         } else {
 
@@ -2308,235 +4525,240 @@ struct object *call_function(struct object *f, struct object *args) {
           }
 #endif
 
-          symbol_set_value(
-              gis->impl_f_sym,
-              DYNAMIC_ARRAY_VALUES(
-                  gis->call_stack)[DYNAMIC_ARRAY_LENGTH(gis->call_stack) - 1]);
-
-          /* if we are returning from a builtin (a builtin called some other function -- this
-             happens with APPLY) return twice. */
-            symbol_set_value(
-                gis->impl_i_sym,
-                DYNAMIC_ARRAY_VALUES(
-                    gis->call_stack)[DYNAMIC_ARRAY_LENGTH(gis->call_stack) -
-                                     2]);
-          /* pop off all stack arguments, then pop bc, then pop instruction
-           * index */
-          DYNAMIC_ARRAY_LENGTH(gis->call_stack) -= ufix0;
+          f = frame->f;
+          i = frame->i;
 
 #if FUNCTION_TRACE
           if (gis->loaded_core) {
             printf("TO: ");
-            print(symbol_get_value(gis->impl_f_sym));
-            print(gis->call_stack);
+            print(f);
+            print(gis->data_stack);
             printf("====================\n");
           }
 #endif
 
           goto eval_restart; /* restart the evaluation loop */
         }
-      case op_jump_forward: /* jump-forward ( -- ) */
+      TARGET(op_jump_forward): /* jump-forward ( -- ) */
         READ_OP_JUMP_ARG();
-        UFIXNUM_VALUE(i) += sa0;
-        continue; /* continue so the usual increment to i doesn't happen */
-      case op_jump_backward: /* jump-forward ( -- ) */
+        i = sa0;
+        DISPATCH(); /* continue so the usual increment to i doesn't happen */
+      TARGET(op_jump_backward): /* jump-forward ( -- ) */
         READ_OP_JUMP_ARG();
-        UFIXNUM_VALUE(i) -= sa0;
-        continue; /* continue so the usual increment to i doesn't happen */
-      case op_jump_forward_when_nil: /* jump_when_nil ( cond -- ) */
+        i = sa0;
+#ifdef AOT
+        if (FUNCTION_AOT(f) != NULL) ENTER_AOT(); /* loops go back into native code */
+#endif
+#ifdef JIT
+        WARM_JIT(); /* loops go back into compiled code (and make it hot too) */
+        if (FUNCTION_JIT(f) != NULL) ENTER_JIT();
+#endif
+        DISPATCH(); /* continue so the usual increment to i doesn't happen */
+      TARGET(op_jump_forward_when_nil): /* jump_when_nil ( cond -- ) */
         READ_OP_JUMP_ARG();
-        v0 = pop(); /* cond */
+        v0 = POP(); /* cond */
         if (v0 == NIL)
-          UFIXNUM_VALUE(i) += sa0;
+          i = sa0;
         else
-          ++UFIXNUM_VALUE(i);
-        continue;    /* continue so the usual increment to i doesn't happen */
-      case op_print: /* print ( x -- NIL ) */
-        SC("print", 1);
+          ++i;
+        DISPATCH();    /* continue so the usual increment to i doesn't happen */
+#ifdef REGISTERS
+      TARGET(op_registers): /* registers ( ... -- ... ) runs a block of register instructions (see "Register form") */
+        READ_OP_ARG();
+        i = run_register_block(&FUNCTION_REGISTER_BLOCKS(f)[a0], locals, constants->values, sp);
+        sp += FUNCTION_REGISTER_BLOCKS(f)[a0].sp_change;
+        DISPATCH();
+#endif
+      TARGET(op_print): /* print ( x -- NIL ) */
         print_no_newline(STACK_I(0));
-        pop();
-        break;
-      case op_print_nl: /* print-nl ( -- ) */
+        --sp;
+        NEXT();
+      TARGET(op_print_nl): /* print-nl ( -- ) */
         printf("\n");
-        break;
-      case op_symbol_value: /* symbol-value ( sym -- ) */
-        SC("symbol-value", 1);
+        NEXT();
+      TARGET(op_symbol_value): /* symbol-value ( sym -- ) */
         STACK_I(0) = symbol_get_value(STACK_I(0));
-        break;
-      case op_symbol_function: /* symbol-function ( sym -- ) */
-        SC("symbol-function", 1);
+        NEXT();
+      TARGET(op_symbol_function): /* symbol-function ( sym -- ) */
         STACK_I(0) = symbol_get_function(STACK_I(0));
-        break;
-      case op_set_symbol_value: /* set-symbol-value ( sym val -- ) */
-        SC("set-symbol-value", 1);
-        v1 = pop(); /* val */
+        NEXT();
+      TARGET(op_set_symbol_value): /* set-symbol-value ( sym val -- ) */
+        v1 = POP(); /* val */
         OT("set-symbol-value", 0, STACK_I(0), type_symbol);
         symbol_set_value(STACK_I(0), v1);
-        break;
-      case op_set_symbol_function: /* set-symbol-function ( sym val -- ) */
-        SC("set-symbol-function", 1);
+        NEXT();
+      TARGET(op_set_symbol_function): /* set-symbol-function ( sym val -- ) */
         /* TODO: this only needs 1 pop */
-        v1 = pop(); /* val */
-        v0 = pop(); /* sym */
+        v1 = POP(); /* val */
+        v0 = POP(); /* sym */
         symbol_set_function(v0, v1);
-        push(v1);
-        break;
-      case op_symbol_type:
-        SC("symbol-type", 1);
+        PUSH(v1);
+        NEXT();
+      TARGET(op_symbol_type):
         STACK_I(0) = symbol_get_type(STACK_I(0));
-        break;
-      case op_type_of:
-        SC("type-of", 1);
+        NEXT();
+      TARGET(op_type_of):
         STACK_I(0) = type_of(STACK_I(0));
-        break;
-      case op_dynamic_array:
-        SC("dynamic-array", 1);
+        NEXT();
+      TARGET(op_dynamic_array):
         OT("dynamic-array", 0, STACK_I(0), type_fixnum);
         STACK_I(0) = dynamic_array(FIXNUM_VALUE(STACK_I(0)));
-        break;
-      case op_dynamic_byte_array:
-        SC("dynamic-byte-array", 1);
+        NEXT();
+      TARGET(op_dynamic_byte_array):
         OT("dynamic-byte-array", 0, STACK_I(0), type_fixnum);
         STACK_I(0) = dynamic_byte_array(FIXNUM_VALUE(STACK_I(0)));
-        break;
-      case op_to_string:
-        SC("to-string", 1);
+        NEXT();
+      TARGET(op_to_string):
         STACK_I(0) = to_string(STACK_I(0));
-        break;
-      case op_dynamic_array_get:
-        SC("dynamic-array-get", 2);
-        STACK_I(0) = dynamic_array_get(STACK_I(1), pop());
-        break;
-      case op_dynamic_array_set:
-        SC("dynamic-array-set", 3);
-        dynamic_array_set(STACK_I(2), STACK_I(1), pop());
-        pop();
+        NEXT();
+      TARGET(op_dynamic_array_get):
+        v1 = POP();
+        STACK_I(0) = dynamic_array_get(STACK_I(0), v1);
+        NEXT();
+      TARGET(op_dynamic_array_set):
+        v1 = POP();
+        dynamic_array_set(STACK_I(1), STACK_I(0), v1);
+        --sp;
         STACK_I(0) = NIL;
-        break;
-      case op_dynamic_array_length:
-        SC("dynamic-array-length", 1);
+        NEXT();
+      TARGET(op_dynamic_array_length):
         STACK_I(0) = dynamic_array_length(STACK_I(0));
-        break;
-      case op_dynamic_array_push:
-        SC("dynamic-array-push", 2);
-        dynamic_array_push(STACK_I(1), pop());
+        NEXT();
+      TARGET(op_dynamic_array_push):
+        v1 = POP();
+        dynamic_array_push(STACK_I(0), v1);
         STACK_I(0) = NIL;
-        break;
-      case op_dynamic_array_pop:
-        SC("dynamic-array-pop", 1);
+        NEXT();
+      TARGET(op_dynamic_array_pop):
         STACK_I(0) = dynamic_array_pop(STACK_I(0));
-        break;
-      case op_dynamic_array_concat:
-        SC("dynamic-array-concat", 2);
-        STACK_I(0) = dynamic_array_concat(STACK_I(1), pop());
-        break;
-      case op_dynamic_byte_array_concat:
-        SC("dynamic-byte-array-concat", 2);
-        STACK_I(0) = dynamic_byte_array_concat(STACK_I(1), pop());
-        break;
-      case op_dynamic_byte_array_get:
-        SC("dynamic-byte-array-get", 2);
+        NEXT();
+      TARGET(op_dynamic_array_concat):
+        v1 = POP();
+        STACK_I(0) = dynamic_array_concat(STACK_I(0), v1);
+        NEXT();
+      TARGET(op_dynamic_byte_array_concat):
+        v1 = POP();
+        STACK_I(0) = dynamic_byte_array_concat(STACK_I(0), v1);
+        NEXT();
+      TARGET(op_dynamic_byte_array_get):
         OT("dynamic-byte-array-get", 1, STACK_I(0), type_fixnum);
-        STACK_I(0) = fixnum(dynamic_byte_array_get(STACK_I(1), FIXNUM_VALUE(pop())));
-        break;
-      case op_dynamic_byte_array_insert:
-        SC("dynamic-byte-array-insert", 3);
+        v1 = POP();
+        STACK_I(0) = fixnum(dynamic_byte_array_get(STACK_I(0), FIXNUM_VALUE(v1)));
+        NEXT();
+      TARGET(op_dynamic_byte_array_insert):
         OT("dynamic-byte-array-insert", 1, STACK_I(1), type_fixnum);
         OT("dynamic-byte-array-insert", 2, STACK_I(0), type_fixnum);
-        dynamic_byte_array_insert_char(STACK_I(2), FIXNUM_VALUE(STACK_I(1)), FIXNUM_VALUE(pop()));
-        pop();
+        v1 = POP();
+        dynamic_byte_array_insert_char(STACK_I(1), FIXNUM_VALUE(STACK_I(0)), FIXNUM_VALUE(v1));
+        --sp;
         STACK_I(0) = NIL;
-        break;
-      case op_dynamic_byte_array_length:
-        SC("dynamic-byte-array-length", 1);
+        NEXT();
+      TARGET(op_dynamic_byte_array_length):
         STACK_I(0) = dynamic_byte_array_length(STACK_I(0));
-        break;
-      case op_dynamic_byte_array_set:
-        SC("dynamic-byte-array-set", 3);
+        NEXT();
+      TARGET(op_dynamic_byte_array_set):
         OT("dynamic-byte-array-set", 1, STACK_I(1), type_fixnum);
         OT("dynamic-byte-array-set", 2, STACK_I(0), type_fixnum);
-        dynamic_byte_array_set(STACK_I(2), FIXNUM_VALUE(STACK_I(1)), FIXNUM_VALUE(pop()));
-        pop();
+        v1 = POP();
+        dynamic_byte_array_set(STACK_I(1), FIXNUM_VALUE(STACK_I(0)), FIXNUM_VALUE(v1));
+        --sp;
         STACK_I(0) = NIL;
-        break;
-      case op_dynamic_byte_array_push:
-        SC("dynamic-array-push", 2);
-        dynamic_byte_array_push(STACK_I(1), pop());
+        NEXT();
+      TARGET(op_dynamic_byte_array_push):
+        v1 = POP();
+        dynamic_byte_array_push(STACK_I(0), v1);
         STACK_I(0) = NIL;
-        break;
-      case op_dynamic_byte_array_pop:
-        SC("dynamic-byte-array-pop", 1);
+        NEXT();
+      TARGET(op_dynamic_byte_array_pop):
         STACK_I(0) = dynamic_byte_array_pop(STACK_I(0));
-        break;
-      case op_alloc_struct:
-        SC("alloc-struct", 1);
+        NEXT();
+      TARGET(op_alloc_struct):
         STACK_I(0) = alloc_struct(STACK_I(0), 1);
-        break;
-      case op_gensym:
-        push(symbol(string_concat(string("gensym-"), to_string(ufixnum(gis->gensym_counter)))));
+        NEXT();
+      TARGET(op_gensym):
+        PUSH(symbol(string_concat(string("gensym-"), to_string(ufixnum(gis->gensym_counter)))));
         ++gis->gensym_counter;
-        break;
-      case op_function_code:
-        SC("function-code", 1);
+        NEXT();
+      TARGET(op_function_code):
         OT("function-code", 0, STACK_I(0), type_function);
-        push(FUNCTION_CODE(GET_LOCAL(0)));
-        break;
-      case op_struct_field:
-        SC("struct-field", 2);
-        STACK_I(0) = struct_field(STACK_I(1), pop());
-        break;
-      case op_set_struct_field:
-        SC("set-struct-field", 3);
-        set_struct_field(STACK_I(2), STACK_I(1), pop());
-        pop();
+        STACK_I(0) = FUNCTION_CODE(STACK_I(0));
+        NEXT();
+      TARGET(op_struct_field):
+        v1 = POP();
+        STACK_I(0) = struct_field(STACK_I(0), v1);
+        NEXT();
+      TARGET(op_set_struct_field):
+        v1 = POP();
+        set_struct_field(STACK_I(1), STACK_I(0), v1);
+        --sp;
         STACK_I(0) = NIL;
-        break;
-      case op_symbol_name:
-        SC("symbol-name", 1);
+        NEXT();
+      TARGET(op_symbol_name):
         OT("symbol-name", 0, STACK_I(0), type_symbol);
         STACK_I(0) = SYMBOL_NAME(STACK_I(0));
-        break;
-      case op_byte_stream:
-        SC("byte-stream", 1);
+        NEXT();
+      TARGET(op_byte_stream):
         STACK_I(0) = byte_stream_lift(STACK_I(0));
-        break;
-      case op_byte_stream_peek:
-        SC("byte-stream-peek", 2);
-        v1 = pop();
+        NEXT();
+      TARGET(op_byte_stream_peek):
+        v1 = POP();
         if (v1 == NIL)
           STACK_I(0) = byte_stream_peek(STACK_I(0), 1);
         else
           STACK_I(0) = byte_stream_peek(STACK_I(0), FIXNUM_VALUE(v1));
-        break;
-      case op_byte_stream_read:
-        SC("byte-stream-read", 2);
-        v1 = pop();
+        NEXT();
+      TARGET(op_byte_stream_read):
+        v1 = POP();
         if (v1 == NIL)
           STACK_I(0) = byte_stream_read(STACK_I(0), 1);
         else
           STACK_I(0) = byte_stream_read(STACK_I(0), FIXNUM_VALUE(v1));
-        break;
-      case op_write_file:
-        SC("write-file", 2);
-        write_file(STACK_I(1), pop());
+        NEXT();
+      TARGET(op_write_file):
+        v1 = POP();
+        write_file(STACK_I(0), v1);
         STACK_I(0) = NIL;
-        break;
-      case op_string_concat:
-        SC("string-concat", 2);
-        STACK_I(0) = string_concat_external(STACK_I(1), pop());
-        break;
-      default:
+        NEXT();
+      TARGET(op_string_concat):
+        v1 = POP();
+        STACK_I(0) = string_concat_external(STACK_I(0), v1);
+        NEXT();
+      TARGET_DEFAULT:
         printf("Invalid op.\n");
         PRINT_STACK_TRACE_AND_QUIT();
         break;
     }
-    ++UFIXNUM_VALUE(i);
+    ++i;
   }
+#ifdef THREADED_DISPATCH
+  end_of_code:
+#endif
+  gis->vm.i = i;
+  SAVE_STACK();
   quit_run:
   return DYNAMIC_ARRAY_LENGTH(gis->data_stack) ? peek() : NIL;
 }
+#ifdef THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
 
 int main(int argc, char **argv) {
+#ifdef OP_PROFILE
+  op_profile_init();
+#endif
+#ifdef REGISTERS
+  register_report_init();
+#endif
+#ifdef JIT
+  jit_init();
+#endif
+#ifdef AOT
+  if (argc == 4 && strcmp(argv[1], "--aot") == 0) { /* bug --aot <bc file> <c file> (see aot.c) */
+    gis_init(0);
+    aot_write_c(read_bytecode_file(open_file(string(argv[2]), string("rb"))), argv[2], argv[3]);
+    return 0;
+  }
+#endif
   gis_init(1);
   return 0;
 }
\ No newline at end of file
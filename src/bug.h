@@ -46,7 +46,23 @@ typedef double flonum_t;
 
 #define OBJECT_TYPE(o) o->w0.type
 
-#define FIXNUM_VALUE(o) o->w1.value.fixnum
+/* Fixnums that fit in a pointer (minus the tag bits) are not allocated. Instead
+   the value is stored directly in the object pointer, tagged with 01 in the two
+   lsbs. Real objects are malloc'd so their pointers always end in 00. The second
+   lsb must stay 0 because a cons stores its car in w0, and a w0 with the second
+   lsb set is read as an object_type (see enum object_type).
+   Fixnums outside of that range fall back to a boxed object with type_fixnum. */
+#define FIXNUM_TAG 1
+#define FIXNUM_TAG_BITS 2
+#define IS_IMMEDIATE_FIXNUM(o) (((uintptr_t)(o)) & FIXNUM_TAG)
+#define MAX_IMMEDIATE_FIXNUM ((fixnum_t)(INTPTR_MAX >> FIXNUM_TAG_BITS))
+#define MIN_IMMEDIATE_FIXNUM ((fixnum_t)(INTPTR_MIN >> FIXNUM_TAG_BITS))
+#define CAN_BE_IMMEDIATE_FIXNUM(n) ((n) >= MIN_IMMEDIATE_FIXNUM && (n) <= MAX_IMMEDIATE_FIXNUM)
+#define IMMEDIATE_FIXNUM(n) ((struct object *)(((uintptr_t)(intptr_t)(n) << FIXNUM_TAG_BITS) | FIXNUM_TAG))
+#define IMMEDIATE_FIXNUM_VALUE(o) ((fixnum_t)(((intptr_t)(o)) >> FIXNUM_TAG_BITS))
+
+/* o is evaluated more than once -- don't pass anything with side effects (like pop()) */
+#define FIXNUM_VALUE(o) (IS_IMMEDIATE_FIXNUM(o) ? IMMEDIATE_FIXNUM_VALUE(o) : (o)->w1.value.fixnum)
 
 #define UFIXNUM_VALUE(o) o->w1.value.ufixnum
 
@@ -64,6 +80,7 @@ typedef double flonum_t;
 #define SYMBOL_VALUE(o) o->w1.value.symbol->value
 #define SYMBOL_FUNCTION(o) o->w1.value.symbol->function
 #define SYMBOL_TYPE(o) o->w1.value.symbol->type
+#define SYMBOL_DEPENDENTS(o) o->w1.value.symbol->dependents
 
 #define ARRAY_LENGTH(o) o->w1.value.array->length
 #define ARRAY_VALUES(o) o->w1.value.array->values
@@ -74,6 +91,7 @@ typedef double flonum_t;
 #define DYNAMIC_BYTE_ARRAY_LENGTH(o) o->w1.value.dynamic_byte_array->length
 #define DYNAMIC_BYTE_ARRAY_CAPACITY(o) o->w1.value.dynamic_byte_array->capacity
 #define DYNAMIC_BYTE_ARRAY_BYTES(o) o->w1.value.dynamic_byte_array->bytes
+#define DYNAMIC_BYTE_ARRAY_VERSION(o) o->w1.value.dynamic_byte_array->version
 #define DYNAMIC_ARRAY_LENGTH(o) o->w1.value.dynamic_array->length
 #define DYNAMIC_ARRAY_CAPACITY(o) o->w1.value.dynamic_array->capacity
 #define DYNAMIC_ARRAY_VALUES(o) o->w1.value.dynamic_array->values
@@ -85,8 +103,22 @@ typedef double flonum_t;
 #define FUNCTION_NAME(o) o->w1.value.function->name
 #define FUNCTION_DOCSTRING(o) o->w1.value.function->docstring
 #define FUNCTION_IS_BUILTIN(o) o->w1.value.function->is_builtin
-#define FUNCTION_ACCEPTS_ALL(o) o->w1.value.function->accepts_all
+#define FUNCTION_BUILTIN_INDEX(o) o->w1.value.function->builtin_index
+#define FUNCTION_NOPTIONAL(o) o->w1.value.function->noptional
+#define FUNCTION_REST(o) o->w1.value.function->rest
 #define FUNCTION_IS_MACRO(o) o->w1.value.function->is_macro
+#define FUNCTION_INSTRUCTIONS(o) o->w1.value.function->instructions
+#define FUNCTION_INSTRUCTION_COUNT(o) o->w1.value.function->instruction_count
+#define FUNCTION_CODE_VERSION(o) o->w1.value.function->code_version
+#define FUNCTION_SHARES_INSTRUCTIONS(o) o->w1.value.function->shares_instructions
+#define FUNCTION_CALL_CACHES(o) o->w1.value.function->call_caches
+#define FUNCTION_MAX_DEPTH(o) o->w1.value.function->max_depth
+#define FUNCTION_CLOSURE(o) o->w1.value.function->closure
+#define FUNCTION_HEAT(o) o->w1.value.function->heat
+#define FUNCTION_JIT(o) o->w1.value.function->jit
+#define FUNCTION_AOT(o) o->w1.value.function->aot
+#define FUNCTION_REGISTER_BLOCKS(o) o->w1.value.function->register_blocks
+#define FUNCTION_REGISTER_BLOCK_COUNT(o) o->w1.value.function->register_block_count
 
 #define STRING_LENGTH(o) DYNAMIC_BYTE_ARRAY_LENGTH(o)
 #define STRING_CONTENTS(o) ((char*)DYNAMIC_BYTE_ARRAY_BYTES(o))
@@ -140,6 +172,15 @@ typedef double flonum_t;
 
 #include "ops.h"
 
+/* Instruction words
+ * run doesn't execute a function's code directly -- it executes a decoded copy (see decode_function).
+ * Each instruction is one 32-bit word: the op is in the low byte, and its argument (if it has one) in
+ * the upper 24 bits. Jump arguments are the absolute index of the instruction to jump to. */
+#define INSTRUCTION(op, arg) ((uint32_t)(op) | ((uint32_t)(arg) << 8))
+#define INSTRUCTION_OP(w) ((w) & 0xFF)
+#define INSTRUCTION_ARG(w) ((w) >> 8)
+#define MAX_INSTRUCTION_ARG 0xFFFFFF
+
 /* The types defined below are not the same as the types that will
    be defined within the language. */
 enum object_type {
@@ -211,6 +252,7 @@ struct dynamic_byte_array {
   ufixnum_t length; /** the number of items in the byte-array (a fixnum) */
   ufixnum_t capacity;
   unsigned char *bytes; /** the contents of the byte-array */
+  ufixnum_t version; /** changed every time the contents are (a function's decoded code is checked against it -- see redecode_function) */
 };
 
 struct symbol {
@@ -220,6 +262,7 @@ struct symbol {
   struct object *function; /** the function value slot */
   struct object *type; /** the type value slot */
   struct object *plist; /** a plist that maps from namespace name to value */
+  struct object *dependents; /** the functions that have this symbol's function inlined (see "Inlining" in bug.c) */
   char is_external;
   char value_is_set;
   char function_is_set;
@@ -266,9 +309,97 @@ struct function {
   struct object *constants; /** an array of constants used within the code (an array) */
   ufixnum_t stack_size; /** how many items to reserve on the stack - includes arguments */
   ufixnum_t nargs; /** how many arguments does this require? */
+  ufixnum_t noptional; /** how many &optional arguments can come after those */
   char is_builtin; /** is this a builtin function? */
+  ufixnum_t builtin_index; /** where the builtin's C function is in the builtins table (see register_builtin) - only if is_builtin */
   char is_macro; /** is this a macro? */
-  char accepts_all; /** is this a (function _ all ...) function? */
+  char rest; /** an enum rest_kind -- does it take the rest of its arguments as a list (see "Parameters" in bug.c)? */
+  uint32_t *instructions; /** the code decoded into instruction words (see decode_function) - NULL until the function is run */
+  ufixnum_t instruction_count; /** how many instruction words are in instructions */
+  ufixnum_t code_version; /** the version of code that instructions were decoded from (see redecode_function) */
+  char shares_instructions; /** are instructions and call_caches shared with a closure (see make_closure)? */
+  struct call_cache *call_caches; /** an inline cache for each instruction (only call instructions use theirs) - NULL if the function makes no calls */
+  ufixnum_t max_depth; /** the most values its code has on the data stack above its locals (see verify_function) */
+  struct object *closure; /** the values a closure loads with load-closure (a dynamic array -- see "Closures" in bug.c), NIL for other functions */
+#ifdef JIT
+  ufixnum_t heat; /** how many times the function has been called or looped (until it is compiled) */
+  struct jit_code *jit; /** the function compiled to machine code (see jit.c) - NULL until it is hot */
+#endif
+#ifdef AOT
+  struct aot_function *aot; /** the function compiled ahead of time to C (see aot.c) - NULL if it wasn't */
+#endif
+#ifdef REGISTERS
+  struct register_block *register_blocks; /** parts of the code translated to register form (see "Register form" in bug.c) */
+  ufixnum_t register_block_count;
+#endif
+};
+
+/* run's registers that native code (see jit.c and aot.c) uses -- native code writes sp back when it exits */
+struct native_state {
+  struct object **sp;
+  struct object **locals;
+  struct object **constants;
+};
+
+/* what a function does with the arguments it is given after its required and optional ones */
+enum rest_kind {
+  rest_none, /* there can't be any */
+  rest_list, /* they are made into a list */
+  rest_reused /* they are made into a list of conses that are reused once the function returns (the compiler
+                 found that the list can't outlive the call) */
+};
+
+/* what kind of function a call site called the last time it was run */
+enum call_target_kind {
+  call_target_bytecode,
+  call_target_builtin,
+  call_target_ffi
+};
+
+/* an inline cache for one call instruction: what was on top of the stack (usually a symbol) the last
+ * time the call was made, the function that was called, and what kind of function it was. It is only
+ * valid while epoch is gis->function_epoch -- which symbol_set_function bumps every time any symbol's
+ * function changes. */
+struct call_cache {
+  struct object *callee;
+  struct object *target;
+  ufixnum_t epoch;
+  enum call_target_kind kind;
+};
+
+/* where a register instruction reads or writes a value (see "Register form" in bug.c) -- index is into
+ * the function's locals, its constants, or the data stack (relative to where sp was when the block
+ * started, so negative indexes are values that were already on the stack) */
+enum register_base {
+  register_locals,
+  register_constants,
+  register_stack,
+  register_nil, /* nil (index is 0) */
+  register_condition /* what decides whether the block jumps (index is 0) */
+};
+
+struct register_operand {
+  unsigned char base; /* an enum register_base */
+  int32_t index;
+};
+
+/* a three-address instruction -- dst = a <op> b */
+struct register_instruction {
+  unsigned char op; /* an enum register_op (see bug.c) */
+  struct register_operand dst, a, b;
+};
+
+/* a run of ops translated to register instructions -- the first op's instruction is replaced with
+ * op_registers, with the block's index as its argument */
+struct register_block {
+  uint32_t word; /* the instruction op_registers replaced */
+  ufixnum_t next; /* the instruction after the ops the block does */
+  ufixnum_t jump; /* where it jumps if its condition is nil (-1 if it ends without a jump) */
+  int32_t sp_change; /* how far sp moves */
+  struct register_instruction *instructions;
+  ufixnum_t count; /* how many instructions */
+  ufixnum_t dispatches; /* how many dispatches its ops would take (with superinstructions) */
+  ufixnum_t runs; /* how many times it has been run (see register_report_write) */
 };
 
 struct file {
@@ -294,6 +425,63 @@ struct vec2 {
   flonum_t y;
 };
 
+/* the most values a function can return (see "Multiple values" in bug.c) */
+#define MAX_VALUES 16
+
+/**
+ * The value a special variable had before a let bound it (see "Special variables" in bug.c).
+ */
+struct binding {
+  struct object *symbol;
+  struct object *value; /** its value before the binding */
+  char value_was_set; /** whether it had one */
+  ufixnum_t depth; /** the frames_length of the function that made it (0 for the top level) */
+};
+
+/**
+ * The registers of the bytecode interpreter.
+ *
+ * These used to live in the values of impl:f and impl:i. run() keeps its own copies in C locals
+ * and only writes them back here when control leaves the current function (calls, builtins, returns).
+ * The impl:f and impl:i symbols are only updated on demand (see materialize_vm_registers).
+ */
+struct vm_state {
+  struct object *f; /** the currently executing function (NIL at the top level) */
+  ufixnum_t i; /** the index of the next instruction in f's code (only up to date across calls) */
+  ufixnum_t fp; /** index of the current function's first local in the data stack */
+  struct frame *frames; /** the frames of the functions that were called (the callers of f) */
+  ufixnum_t frames_length;
+  ufixnum_t frames_capacity;
+  struct object *free_conses; /** the conses of rest lists that are reused (linked by their cdrs -- see enum rest_kind) */
+  ufixnum_t nvalues; /** how many values the function that returned last returned */
+  struct object *values[MAX_VALUES - 1]; /** its values after the first one */
+  struct binding *bindings; /** the bindings of special variables that haven't ended (the latest last) */
+  ufixnum_t bindings_length;
+  ufixnum_t bindings_capacity;
+  void **retired; /** replaced instructions and call caches that a closure may still use (see redecode_function) */
+  ufixnum_t retired_length;
+  ufixnum_t retired_capacity;
+};
+
+/**
+ * A function call.
+ *
+ * Locals (arguments first) and temporaries share one stack (gis->data_stack). When a function is called
+ * its arguments become its first locals in place, the rest of its locals come right after, and its
+ * temporaries go above those:
+ *
+ *   [ ...caller... | arg_0 ... arg_n  local_n+1 ... | temporaries... ]
+ *                    ^ gis->vm.fp
+ *
+ * The registers of the caller are saved in a frame record, which lives in a separate stack (gis->vm.frames).
+ */
+struct frame {
+  struct object *f; /** the caller (NIL if the call was made from the top level) */
+  ufixnum_t i; /** the instruction to resume the caller at */
+  ufixnum_t fp; /** the caller's frame pointer */
+  struct object *rest; /** the rest list of the function that returns to this frame, if its conses are reused (NIL if not -- see enum rest_kind) */
+};
+
 /**
  * The global interpreter state.
  * 
@@ -304,12 +492,14 @@ struct vec2 {
  * builtins are handled through builtin objects, not symbols.
  */
 struct gis {
-  struct object *data_stack; /** same as the value in data_stack_symbol */
-  struct object *call_stack; /** same as the value in call_stack_symbol */
+  struct object *data_stack; /** same as the value in data_stack_symbol (holds locals and temporaries -- see struct frame) */
   struct object *types;
   char loaded_core;
 
+  struct vm_state vm;
+
   ufixnum_t gensym_counter;
+  ufixnum_t function_epoch; /** changes whenever a symbol's function is set (see struct call_cache) */
 
   struct object *standard_out;
   struct object *standard_in;
@@ -331,11 +521,10 @@ struct gis {
   struct object *impl_byte_stream_read_sym;
   struct object *impl_byte_stream_has_sym;
   struct object *impl_call_sym;
-  struct object *impl_call_stack_sym; /** stack for saving stack pointers and values for function calls (a cons list) */
   struct object *impl_change_directory_sym;
   struct object *impl_close_file_sym;
   struct object *impl_continue_sym;
-  struct object *impl_data_stack_sym; /** the data stack (a cons list) */
+  struct object *impl_data_stack_sym; /** the data stack (a dynamic array) */
   struct object *impl_debugger_sym;
   struct object *impl_define_function_sym;
   struct object *impl_define_struct_sym;
@@ -354,14 +543,16 @@ struct gis {
   struct object *impl_dynamic_byte_array_set_sym;
   struct object *impl_dynamic_byte_array_push_sym;
   struct object *impl_dynamic_byte_array_pop_sym;
-  struct object *impl_f_sym; /** the currently executing function */
+  struct object *impl_f_sym; /** the currently executing function (see gis->vm) */
   struct object *impl_function_sym;
   struct object *impl_function_code_sym;
   struct object *impl_get_current_working_directory_sym;
   struct object *impl_read_bytecode_file_sym;
   struct object *impl_read_file_sym;
+  struct object *impl_define_inline_sym;
+  struct object *impl_record_inlining_sym;
   struct object *impl_struct_field_sym;
-  struct object *impl_i_sym; /** the index of the next instruction in bc to execute */
+  struct object *impl_i_sym; /** the index of the next instruction in bc to execute (see gis->vm) */
   struct object *impl_macro_sym;
   struct object *impl_make_function_sym;
   struct object *impl_marshal_sym;
@@ -373,6 +564,7 @@ struct gis {
   struct object *impl_strings_sym;
   struct object *impl_string_concat_sym;
   struct object *impl_set_struct_field_sym;
+  struct object *impl_set_symbol_property_sym;
   struct object *impl_symbol_type_sym;
   struct object *impl_type_of_sym;
   struct object *impl_unmarshal_sym;
@@ -404,6 +596,7 @@ struct gis {
   struct object *lisp_gt_sym;
   struct object *lisp_gte_sym;
   struct object *lisp_if_sym;
+  struct object *lisp_inline_sym;
   struct object *lisp_intern_sym;
   struct object *lisp_let_sym;
   struct object *lisp_list_sym;
@@ -429,6 +622,8 @@ struct gis {
   struct object *lisp_shift_right_sym;
   struct object *lisp_symbol_function_sym;
   struct object *lisp_symbol_name_sym;
+  struct object *lisp_symbol_plist_sym;
+  struct object *lisp_symbol_property_sym;
   struct object *lisp_symbol_value_sym;
   struct object *lisp_symbol_value_set_sym;
   struct object *lisp_sub_sym;
@@ -551,6 +746,8 @@ struct gis {
   struct object *gensym_builtin;
   struct object *read_bytecode_file_builtin;
   struct object *read_file_builtin;
+  struct object *define_inline_builtin;
+  struct object *record_inlining_builtin;
   struct object *string_concat_builtin;
   struct object *struct_field_builtin;
   struct object *to_string_builtin;
@@ -564,8 +761,11 @@ struct gis {
   struct object *package_symbols_builtin;
   struct object *package_name_builtin;
   struct object *set_struct_field_builtin;
+  struct object *set_symbol_property_builtin;
   struct object *define_struct_builtin;
   struct object *symbol_name_builtin;
+  struct object *symbol_plist_builtin;
+  struct object *symbol_property_builtin;
   struct object *symbol_type_builtin;
   struct object *symbol_value_set_builtin;
   struct object *type_of_builtin;
@@ -583,6 +783,12 @@ struct gis {
 #include "dynamic_array.h"
 #include "os.h"
 #include "ffi.h"
+#ifdef JIT
+#include "jit.h"
+#endif
+#ifdef AOT
+#include "aot.h"
+#endif
 
 /**
  * The global interpreter state
@@ -614,6 +820,7 @@ struct object *symbol_get_value(struct object *sym);
 struct object *symbol_get_type(struct object *sym);
 
 void symbol_set_type(struct object *sym, struct object *t);
+void deoptimize_dependents(struct object *sym);
 void symbol_set_function(struct object *sym, struct object *f);
 void symbol_set_value(struct object *sym, struct object *value);
 
@@ -631,18 +838,36 @@ struct object *dynamic_byte_array(ufixnum_t initial_capacity);
 struct object *ffun(struct object *dlib, struct object *ffname, struct object* ret_type, struct object *param_types);
 struct object *pointer(void *ptr);
 struct object *function(struct object *constants, struct object *code, ufixnum_t stack_size);
+struct object *make_closure(struct object *f, struct object **values, ufixnum_t count);
+void set_function_parameters(struct object *f, ufixnum_t nargs, ufixnum_t parameters);
+ufixnum_t function_parameters(struct object *f);
+struct object *make_rest_list(struct object **values, ufixnum_t count, char reuse);
+void free_rest_list(struct object *list);
+void bind_special(struct object *sym, struct object *value);
+void unbind_specials(ufixnum_t count);
+void unwind_bindings(ufixnum_t length);
+ufixnum_t print_bindings(ufixnum_t length, ufixnum_t depth);
 struct object *string(char *contents);
 struct object *enumerator(struct object *source);
 struct object *package(struct object *name);
 struct object *cons(struct object *car, struct object *cdr);
 struct object *symbol(struct object *name);
 struct object *type(struct object *name, struct object *struct_fields, char can_instantiate, char builtin);
+struct object *struct_field(struct object *instance, struct object *sdes);
 struct object *file_stdin();
 struct object *file_stdout();
 struct object *open_file(struct object *path, struct object *mode);
 void close_file(struct object *file);
 
 void print_stack();
+void decode_function(struct object *f);
+void redecode_function(struct object *f);
+unsigned char bytecode_op_of(unsigned char op);
+unsigned char checked_op_of(unsigned char op);
+uint32_t decoded_instruction(struct object *f, ufixnum_t i);
+struct object *arithmetic(char *name, unsigned char op, struct object *x, struct object *y);
+char compare_numbers(char *name, unsigned char op, struct object *x, struct object *y);
+void materialize_vm_registers();
 
 struct object *intern(struct object *string, struct object *package);
 struct object *find_package(struct object *name);
@@ -653,4 +878,9 @@ struct object *read_file(struct object *file);
 
 struct object *call_function(struct object *f, struct object *args);
 
+/* the C function behind a builtin -- takes the builtin's arguments and returns its result */
+typedef struct object *(*builtin_fn)(struct object **args, ufixnum_t nargs);
+struct object *register_builtin(struct object *name, ufixnum_t nargs, builtin_fn fn);
+void init_builtins();
+
 #endif
\ No newline at end of file
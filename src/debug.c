@@ -25,20 +25,6 @@ void type_check_or2(char *name, unsigned int argument, struct object *o,
   }
 }
 
-/**
- * Checks the number of items on the stack (for bytecode interpreter)
- */
-void stack_check(char *name, int n, unsigned long i) {
-  unsigned int stack_count = DYNAMIC_ARRAY_LENGTH(gis->data_stack);
-  if (stack_count < n) {
-    printf(
-        "BC: Operation \"%s\" was called when the stack had too "
-        "few items. Expected %d items on the stack, but were %d (at instruction %lu).\n",
-        name, n, stack_count, i);
-    PRINT_STACK_TRACE_AND_QUIT();
-  }
-}
-
 void object_type_check_list(char *name, unsigned int argument, struct object *o) {
   enum object_type t1;
   t1 = object_type_of(o);
@@ -38,7 +38,6 @@ struct object *dynamic_array_set_ufixnum_t(struct object *da, ufixnum_t index, s
 void dynamic_array_set(struct object *da, struct object *index, struct object *value) {
   OT("dynamic_array_set", 0, da, type_dynamic_array);
   OT("dynamic_array_set", 1, index, type_fixnum);
-  OT("dynamic_array_set", 2, value, type_fixnum);
   #ifdef RUN_TIME_CHECKS
     if (FIXNUM_VALUE(index) >= DYNAMIC_ARRAY_LENGTH(da)) {
       printf("Index out of bounds.\n");
@@ -69,6 +68,20 @@ void dynamic_array_ensure_capacity(struct object *da) {
   }
 }
 
+/* makes room for n more values (without changing the length) */
+void dynamic_array_reserve(struct object *da, ufixnum_t n) {
+  struct object **nv;
+  if (DYNAMIC_ARRAY_LENGTH(da) + n > DYNAMIC_ARRAY_CAPACITY(da)) {
+    DYNAMIC_ARRAY_CAPACITY(da) = (DYNAMIC_ARRAY_LENGTH(da) + n) * 3/2.0;
+    nv = realloc(DYNAMIC_ARRAY_VALUES(da), DYNAMIC_ARRAY_CAPACITY(da) * sizeof(struct object*));
+    if (nv == NULL) {
+      printf("BC: Failed to realloc dynamic-array.");
+      PRINT_STACK_TRACE_AND_QUIT();
+    }
+    DYNAMIC_ARRAY_VALUES(da) = nv;
+  }
+}
+
 void dynamic_array_push(struct object *da, struct object *value) {
   OT("dynamic_array_push", 0, da, type_dynamic_array);
   dynamic_array_ensure_capacity(da);
@@ -20,6 +20,7 @@ void dynamic_byte_array_set(struct object *dba, ufixnum_t index, char value) {
     }
   #endif
   DYNAMIC_BYTE_ARRAY_BYTES(dba)[index] = value;
+  ++DYNAMIC_BYTE_ARRAY_VERSION(dba);
 }
 
 struct object *dynamic_byte_array_length(struct object *dba) {
@@ -42,6 +43,7 @@ struct object *dynamic_byte_array_push(struct object *dba, struct object *value)
   OT("dynamic_byte_array_push", 1, value, type_fixnum);
   dynamic_byte_array_ensure_capacity(dba);
   DYNAMIC_BYTE_ARRAY_BYTES(dba)[DYNAMIC_BYTE_ARRAY_LENGTH(dba)++] = FIXNUM_VALUE(value);
+  ++DYNAMIC_BYTE_ARRAY_VERSION(dba);
   return NIL;
 }
 
@@ -50,6 +52,7 @@ void dynamic_byte_array_push_char(struct object *dba, char x) {
   OT2("dynamic_byte_array_push_char", 0, dba, type_dynamic_byte_array, type_string);
   dynamic_byte_array_ensure_capacity(dba);
   DYNAMIC_BYTE_ARRAY_BYTES(dba)[DYNAMIC_BYTE_ARRAY_LENGTH(dba)++] = x;
+  ++DYNAMIC_BYTE_ARRAY_VERSION(dba);
 }
 
 /* It is required that there is no validation done on the dba that is passed here, otherwise it will cause an infinite loop with type_of */
@@ -80,6 +83,7 @@ void dynamic_byte_array_insert_char(struct object *dba, ufixnum_t i, char x) {
   }
   DYNAMIC_BYTE_ARRAY_BYTES(dba)[i] = x;
   ++DYNAMIC_BYTE_ARRAY_LENGTH(dba);
+  ++DYNAMIC_BYTE_ARRAY_VERSION(dba);
 }
 
 struct object *dynamic_byte_array_pop(struct object *dba) {
@@ -89,6 +93,7 @@ struct object *dynamic_byte_array_pop(struct object *dba) {
     PRINT_STACK_TRACE_AND_QUIT();
   }
   DYNAMIC_BYTE_ARRAY_LENGTH(dba)--;
+  ++DYNAMIC_BYTE_ARRAY_VERSION(dba);
   return NIL;
 }
 
@@ -0,0 +1,554 @@
+#define _DEFAULT_SOURCE /* for MAP_ANONYMOUS */
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+
+/* JIT
+ * When bug is built with the BUG_JIT cmake option (x86-64 Linux only), a function that has been called
+ * (or gone around a loop) more than jit_threshold times (the BUG_JIT_THRESHOLD environment variable,
+ * 100 by default) is compiled to machine code. Each of its instructions becomes a template of machine
+ * code that does what run does for that op, and the templates are laid out in the same order as the
+ * instructions. Simple ops (locals, constants, jumps, fixnum arithmetic and comparisons, and, or, car and
+ * cdr) are done inline, and a few others call the same C function run does (cons, symbol_get_value,
+ * struct_field, dynamic_array_get and equals).
+ *
+ * Compiled code never does anything that could run bytecode. For any other op (calls, returns, printing,
+ * ...), and for operands the inline code doesn't handle (like adding flonums), it exits back to run,
+ * which runs that instruction itself and carries on interpreting. run goes back into the compiled code
+ * whenever it (re)starts the function -- when it is called, or when a call it made returns -- and on
+ * backward jumps. So calls, returns, frames (print_stack), call caches (functions being redefined) and
+ * errors are all still handled by run. Because compiled code is never on the C stack while bytecode is
+ * running, it can be thrown away at any time (see jit_free).
+ *
+ * Compiled code doesn't check that the stack has enough values for an op, or room to push one (see
+ * "Verifier" in bug.c).
+ *
+ * The compiled code of a function is a C function that takes the native_state (see bug.h) and where to
+ * start, and returns the instruction that run should go on from. While it runs it keeps run's registers
+ * in callee-saved registers:
+ *   rbx -- sp, r12 -- locals, r13 -- constants, r14 -- the native_state
+ * (r15 is saved and restored too, only to keep the C stack 16 byte aligned)
+ */
+
+ufixnum_t jit_threshold = 100;
+
+enum jit_register {
+  reg_rax, reg_rcx, reg_rdx, reg_rbx, reg_rsp, reg_rbp, reg_rsi, reg_rdi,
+  reg_r8, reg_r9, reg_r10, reg_r11, reg_r12, reg_r13, reg_r14, reg_r15
+};
+
+#define REG_SP reg_rbx
+#define REG_LOCALS reg_r12
+#define REG_CONSTANTS reg_r13
+#define REG_STATE reg_r14
+
+/* condition codes (the low 4 bits of jcc and cmovcc) */
+enum jit_condition {
+  cc_o = 0x0,
+  cc_ae = 0x3,
+  cc_e = 0x4,
+  cc_ne = 0x5,
+  cc_l = 0xC,
+  cc_ge = 0xD,
+  cc_le = 0xE,
+  cc_g = 0xF,
+  cc_always = 0x10 /* not a real condition -- a jmp */
+};
+
+/* a 32-bit jump offset that is filled in once everything has been laid out */
+struct jit_patch {
+  ufixnum_t at; /* where the offset is in the code */
+  ufixnum_t instruction; /* the instruction it jumps to */
+  char exit; /* jump to the exit for instruction (instead of its code) */
+};
+
+/* what is kept while compiling a function */
+struct jit_compiler {
+  struct object *code; /* a dynamic byte array */
+  ufixnum_t *entries; /* where each instruction's code starts (instruction_count + 1) */
+  ufixnum_t *exits; /* where each instruction's exit is (-1 if nothing exits there yet) */
+  struct jit_patch *patches;
+  ufixnum_t patches_length, patches_capacity;
+};
+
+void jit_init() {
+  char *threshold;
+  threshold = getenv("BUG_JIT_THRESHOLD");
+  if (threshold != NULL) jit_threshold = strtoul(threshold, NULL, 10);
+}
+
+/*
+ * Encoding x86-64 instructions
+ */
+void emit(struct jit_compiler *c, unsigned char byte) {
+  dynamic_byte_array_push_char(c->code, byte);
+}
+
+void emit_u32(struct jit_compiler *c, uint32_t x) {
+  emit(c, x & 0xFF);
+  emit(c, (x >> 8) & 0xFF);
+  emit(c, (x >> 16) & 0xFF);
+  emit(c, (x >> 24) & 0xFF);
+}
+
+void emit_u64(struct jit_compiler *c, uint64_t x) {
+  emit_u32(c, x & 0xFFFFFFFF);
+  emit_u32(c, x >> 32);
+}
+
+ufixnum_t emit_offset(struct jit_compiler *c) {
+  return DYNAMIC_BYTE_ARRAY_LENGTH(c->code);
+}
+
+/* REX.W prefix with the 4th bits of the ModRM reg and rm fields */
+void emit_rex(struct jit_compiler *c, int reg, int rm) {
+  emit(c, 0x48 | ((reg & 8) >> 1) | ((rm & 8) >> 3));
+}
+
+/* <opcode> reg, [base + disp] (or [base + disp], reg -- depending on the opcode) */
+void emit_memory(struct jit_compiler *c, unsigned char opcode, int reg, int base, int32_t disp) {
+  emit_rex(c, reg, base);
+  emit(c, opcode);
+  emit(c, 0x80 | ((reg & 7) << 3) | (base & 7)); /* always a 32-bit displacement */
+  if ((base & 7) == reg_rsp) emit(c, 0x24); /* rsp and r12 can only be a base with a SIB byte */
+  emit_u32(c, (uint32_t)disp);
+}
+
+/* <opcode> rm, reg for two registers */
+void emit_registers(struct jit_compiler *c, unsigned char opcode, int reg, int rm) {
+  emit_rex(c, reg, rm);
+  emit(c, opcode);
+  emit(c, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void emit_load(struct jit_compiler *c, int reg, int base, int32_t disp) { /* mov reg, [base + disp] */
+  emit_memory(c, 0x8B, reg, base, disp);
+}
+
+void emit_store(struct jit_compiler *c, int base, int32_t disp, int reg) { /* mov [base + disp], reg */
+  emit_memory(c, 0x89, reg, base, disp);
+}
+
+void emit_move(struct jit_compiler *c, int to, int from) { /* mov to, from */
+  emit_registers(c, 0x89, from, to);
+}
+
+void emit_move_immediate(struct jit_compiler *c, int reg, uint64_t x) { /* mov reg, x */
+  emit(c, 0x48 | ((reg & 8) >> 3));
+  emit(c, 0xB8 | (reg & 7));
+  emit_u64(c, x);
+}
+
+void emit_add(struct jit_compiler *c, int to, int from) { /* add to, from */
+  emit_registers(c, 0x01, from, to);
+}
+
+void emit_sub(struct jit_compiler *c, int to, int from) { /* sub to, from */
+  emit_registers(c, 0x29, from, to);
+}
+
+void emit_and(struct jit_compiler *c, int to, int from) { /* and to, from */
+  emit_registers(c, 0x21, from, to);
+}
+
+void emit_compare(struct jit_compiler *c, int a, int b) { /* cmp a, b */
+  emit_registers(c, 0x39, b, a);
+}
+
+void emit_multiply(struct jit_compiler *c, int to, int from) { /* imul to, from */
+  emit_rex(c, to, from);
+  emit(c, 0x0F);
+  emit(c, 0xAF);
+  emit(c, 0xC0 | ((to & 7) << 3) | (from & 7));
+}
+
+/* add/sub/cmp reg, x -- ext is the ModRM reg field that picks which one */
+void emit_immediate_op(struct jit_compiler *c, int ext, int reg, int32_t x) {
+  emit(c, 0x48 | ((reg & 8) >> 3));
+  emit(c, 0x81);
+  emit(c, 0xC0 | (ext << 3) | (reg & 7));
+  emit_u32(c, (uint32_t)x);
+}
+#define emit_add_immediate(c, reg, x) emit_immediate_op(c, 0, reg, x)
+#define emit_sub_immediate(c, reg, x) emit_immediate_op(c, 5, reg, x)
+
+void emit_shift_right(struct jit_compiler *c, int reg, unsigned char n) { /* sar reg, n */
+  emit(c, 0x48 | ((reg & 8) >> 3));
+  emit(c, 0xC1);
+  emit(c, 0xF8 | (reg & 7));
+  emit(c, n);
+}
+
+void emit_test_low_byte(struct jit_compiler *c, int reg, unsigned char x) { /* test <low byte of reg>, x (rax-rbx only) */
+  emit(c, 0xF6);
+  emit(c, 0xC0 | reg);
+  emit(c, x);
+}
+
+void emit_conditional_move(struct jit_compiler *c, int condition, int to, int from) { /* cmovcc to, from */
+  emit_rex(c, to, from);
+  emit(c, 0x0F);
+  emit(c, 0x40 | condition);
+  emit(c, 0xC0 | ((to & 7) << 3) | (from & 7));
+}
+
+void emit_push(struct jit_compiler *c, int reg) {
+  if (reg & 8) emit(c, 0x41);
+  emit(c, 0x50 | (reg & 7));
+}
+
+void emit_pop(struct jit_compiler *c, int reg) {
+  if (reg & 8) emit(c, 0x41);
+  emit(c, 0x58 | (reg & 7));
+}
+
+/* calls a C function (its arguments must already be in rdi, rsi, ...) */
+void emit_call(struct jit_compiler *c, uintptr_t function) {
+  emit_move_immediate(c, reg_rax, function);
+  emit(c, 0xFF); /* call rax */
+  emit(c, 0xD0);
+}
+
+/* jumps to the code (or the exit) of an instruction -- the offset is filled in by jit_compile */
+void emit_jump(struct jit_compiler *c, int condition, ufixnum_t instruction, char to_exit) {
+  struct jit_patch *patch;
+  if (condition == cc_always) {
+    emit(c, 0xE9);
+  } else {
+    emit(c, 0x0F);
+    emit(c, 0x80 | condition);
+  }
+  if (c->patches_length >= c->patches_capacity) {
+    c->patches_capacity *= 2;
+    c->patches = realloc(c->patches, sizeof(struct jit_patch) * c->patches_capacity);
+    if (c->patches == NULL) {
+      printf("Failed to grow JIT patches.");
+      PRINT_STACK_TRACE_AND_QUIT();
+    }
+  }
+  patch = &c->patches[c->patches_length++];
+  patch->at = emit_offset(c);
+  patch->instruction = instruction;
+  patch->exit = to_exit;
+  if (to_exit) c->exits[instruction] = 0; /* needed (jit_compile lays it out at the end) */
+  emit_u32(c, 0);
+}
+
+/*
+ * Templates
+ */
+
+void emit_push_rax(struct jit_compiler *c) {
+  emit_store(c, REG_SP, 0, reg_rax);
+  emit_add_immediate(c, REG_SP, sizeof(struct object *));
+}
+
+/* x in rax and y in rcx -- exits to run at instruction i if they aren't both immediate fixnums */
+void emit_load_fixnum_operands(struct jit_compiler *c, ufixnum_t i) {
+  emit_load(c, reg_rax, REG_SP, -2 * (int32_t)sizeof(struct object *));
+  emit_load(c, reg_rcx, REG_SP, -(int32_t)sizeof(struct object *));
+  emit_move(c, reg_rdx, reg_rax);
+  emit_and(c, reg_rdx, reg_rcx);
+  emit_test_low_byte(c, reg_rdx, FIXNUM_TAG);
+  emit_jump(c, cc_e, i, 1);
+}
+
+/* replaces x and y with the result in reg */
+void emit_binary_result(struct jit_compiler *c, int reg) {
+  emit_store(c, REG_SP, -2 * (int32_t)sizeof(struct object *), reg);
+  emit_sub_immediate(c, REG_SP, sizeof(struct object *));
+}
+
+/* replaces x and y with t or nil -- condition is the result of comparing them */
+void emit_boolean_result(struct jit_compiler *c, int condition) {
+  emit_move_immediate(c, reg_rax, (uintptr_t)NIL);
+  emit_move_immediate(c, reg_rdx, (uintptr_t)T);
+  emit_conditional_move(c, condition, reg_rax, reg_rdx);
+  emit_binary_result(c, reg_rax);
+}
+
+/* calls function with the top value (and replaces it with the result) */
+void emit_unary_call(struct jit_compiler *c, uintptr_t function) {
+  emit_load(c, reg_rdi, REG_SP, -(int32_t)sizeof(struct object *));
+  emit_call(c, function);
+  emit_store(c, REG_SP, -(int32_t)sizeof(struct object *), reg_rax);
+}
+
+/* calls function with the top two values (and replaces them with the result) */
+void emit_binary_call(struct jit_compiler *c, uintptr_t function) {
+  emit_load(c, reg_rdi, REG_SP, -2 * (int32_t)sizeof(struct object *));
+  emit_load(c, reg_rsi, REG_SP, -(int32_t)sizeof(struct object *));
+  emit_call(c, function);
+  emit_binary_result(c, reg_rax);
+}
+
+/* car/cdr of nil is nil, and of a cons is read from the given word -- anything else exits to run */
+void emit_cons_part(struct jit_compiler *c, ufixnum_t i, int32_t part) {
+  ufixnum_t done;
+  emit_load(c, reg_rax, REG_SP, -(int32_t)sizeof(struct object *));
+  emit_move_immediate(c, reg_rcx, (uintptr_t)NIL);
+  emit_compare(c, reg_rax, reg_rcx);
+  emit(c, 0x74); /* je done (nil stays where it is) */
+  emit(c, 0);
+  done = emit_offset(c);
+  emit_test_low_byte(c, reg_rax, FIXNUM_TAG);
+  emit_jump(c, cc_ne, i, 1);
+  emit_load(c, reg_rdx, reg_rax, 0);
+  emit_test_low_byte(c, reg_rdx, 2); /* has an object type (see HAS_OBJECT_TYPE) */
+  emit_jump(c, cc_ne, i, 1);
+  emit_load(c, reg_rax, reg_rax, part);
+  emit_store(c, REG_SP, -(int32_t)sizeof(struct object *), reg_rax);
+  DYNAMIC_BYTE_ARRAY_BYTES(c->code)[done - 1] = emit_offset(c) - done;
+}
+
+void emit_instruction(struct jit_compiler *c, ufixnum_t i, uint32_t word) {
+  unsigned char op;
+  ufixnum_t arg;
+  op = checked_op_of(bytecode_op_of(INSTRUCTION_OP(word)));
+  arg = INSTRUCTION_ARG(word);
+  switch (op) {
+    case op_load_from_stack_0:
+    case op_load_from_stack_1:
+      arg = op - op_load_from_stack_0;
+    case op_load_from_stack:
+      emit_load(c, reg_rax, REG_LOCALS, arg * sizeof(struct object *));
+      emit_push_rax(c);
+      break;
+    case op_store_to_stack_0:
+    case op_store_to_stack_1:
+      arg = op - op_store_to_stack_0;
+    case op_store_to_stack:
+      emit_sub_immediate(c, REG_SP, sizeof(struct object *));
+      emit_load(c, reg_rax, REG_SP, 0);
+      emit_store(c, REG_LOCALS, arg * sizeof(struct object *), reg_rax);
+      break;
+    case op_const_0:
+    case op_const_1:
+    case op_const_2:
+    case op_const_3:
+      arg = op - op_const_0;
+    case op_const:
+      emit_load(c, reg_rax, REG_CONSTANTS, arg * sizeof(struct object *));
+      emit_push_rax(c);
+      break;
+    case op_load_nil:
+      emit_move_immediate(c, reg_rax, (uintptr_t)NIL);
+      emit_push_rax(c);
+      break;
+    case op_drop:
+      emit_sub_immediate(c, REG_SP, sizeof(struct object *));
+      break;
+    case op_dup:
+      emit_load(c, reg_rax, REG_SP, -(int32_t)sizeof(struct object *));
+      emit_push_rax(c);
+      break;
+    case op_push_arg:
+    case op_push_args:
+      break;
+    case op_jump_forward:
+    case op_jump_backward:
+      emit_jump(c, cc_always, arg, 0);
+      break;
+    case op_jump_forward_when_nil:
+      emit_sub_immediate(c, REG_SP, sizeof(struct object *));
+      emit_load(c, reg_rax, REG_SP, 0);
+      emit_move_immediate(c, reg_rcx, (uintptr_t)NIL);
+      emit_compare(c, reg_rax, reg_rcx);
+      emit_jump(c, cc_e, arg, 0);
+      break;
+    /* tagged fixnums can be added and subtracted (and compared) directly -- overflowing means the
+       result is too big for an immediate fixnum, so that is left to run */
+    case op_add:
+      emit_load_fixnum_operands(c, i);
+      emit_sub_immediate(c, reg_rax, FIXNUM_TAG);
+      emit_add(c, reg_rax, reg_rcx);
+      emit_jump(c, cc_o, i, 1);
+      emit_binary_result(c, reg_rax);
+      break;
+    case op_sub:
+      emit_load_fixnum_operands(c, i);
+      emit_sub(c, reg_rax, reg_rcx);
+      emit_jump(c, cc_o, i, 1);
+      emit_add_immediate(c, reg_rax, FIXNUM_TAG);
+      emit_binary_result(c, reg_rax);
+      break;
+    case op_addi:
+    case op_subi: /* n shifted like a fixnum can be added to (or subtracted from) a tagged fixnum directly */
+      if (arg > (ufixnum_t)INT32_MAX >> FIXNUM_TAG_BITS) {
+        emit_jump(c, cc_always, i, 1);
+        break;
+      }
+      emit_load(c, reg_rax, REG_SP, -(int32_t)sizeof(struct object *));
+      emit_test_low_byte(c, reg_rax, FIXNUM_TAG);
+      emit_jump(c, cc_e, i, 1);
+      if (op == op_addi)
+        emit_add_immediate(c, reg_rax, (int32_t)(arg << FIXNUM_TAG_BITS));
+      else
+        emit_sub_immediate(c, reg_rax, (int32_t)(arg << FIXNUM_TAG_BITS));
+      emit_jump(c, cc_o, i, 1);
+      emit_store(c, REG_SP, -(int32_t)sizeof(struct object *), reg_rax);
+      break;
+    case op_mul: /* x's value times y without its tag is the product shifted like a fixnum */
+      emit_load_fixnum_operands(c, i);
+      emit_shift_right(c, reg_rax, FIXNUM_TAG_BITS);
+      emit_sub_immediate(c, reg_rcx, FIXNUM_TAG);
+      emit_multiply(c, reg_rax, reg_rcx);
+      emit_jump(c, cc_o, i, 1);
+      emit_add_immediate(c, reg_rax, FIXNUM_TAG);
+      emit_binary_result(c, reg_rax);
+      break;
+    case op_lt:
+    case op_gt:
+    case op_lte:
+    case op_gte:
+      emit_load_fixnum_operands(c, i);
+      emit_compare(c, reg_rax, reg_rcx);
+      emit_boolean_result(c, op == op_lt ? cc_l : op == op_gt ? cc_g : op == op_lte ? cc_le : cc_ge);
+      break;
+    case op_and: /* y, or nil if x is nil */
+      emit_load(c, reg_rax, REG_SP, -2 * (int32_t)sizeof(struct object *));
+      emit_load(c, reg_rcx, REG_SP, -(int32_t)sizeof(struct object *));
+      emit_move_immediate(c, reg_rdx, (uintptr_t)NIL);
+      emit_compare(c, reg_rax, reg_rdx);
+      emit_conditional_move(c, cc_e, reg_rcx, reg_rdx);
+      emit_binary_result(c, reg_rcx);
+      break;
+    case op_or: /* y, or x if y is nil */
+      emit_load(c, reg_rax, REG_SP, -2 * (int32_t)sizeof(struct object *));
+      emit_load(c, reg_rcx, REG_SP, -(int32_t)sizeof(struct object *));
+      emit_move_immediate(c, reg_rdx, (uintptr_t)NIL);
+      emit_compare(c, reg_rcx, reg_rdx);
+      emit_conditional_move(c, cc_e, reg_rcx, reg_rax);
+      emit_binary_result(c, reg_rcx);
+      break;
+    case op_eq:
+      emit_load(c, reg_rdi, REG_SP, -2 * (int32_t)sizeof(struct object *));
+      emit_load(c, reg_rsi, REG_SP, -(int32_t)sizeof(struct object *));
+      emit_call(c, (uintptr_t)equals);
+      emit_test_low_byte(c, reg_rax, 0xFF); /* equals returns a char */
+      emit_boolean_result(c, cc_ne);
+      break;
+    case op_car:
+      emit_cons_part(c, i, offsetof(struct object, w0));
+      break;
+    case op_cdr:
+      emit_cons_part(c, i, offsetof(struct object, w1));
+      break;
+    case op_cons:
+      emit_binary_call(c, (uintptr_t)cons);
+      break;
+    case op_symbol_value:
+      emit_unary_call(c, (uintptr_t)symbol_get_value);
+      break;
+    case op_struct_field:
+      emit_binary_call(c, (uintptr_t)struct_field);
+      break;
+    case op_dynamic_array_get:
+      emit_binary_call(c, (uintptr_t)dynamic_array_get);
+      break;
+    default: /* run does everything else */
+      emit_jump(c, cc_always, i, 1);
+      break;
+  }
+}
+
+struct jit_code *jit_compile(struct object *f) {
+  struct jit_compiler c;
+  struct jit_code *jit;
+  struct jit_patch *patch;
+  ufixnum_t i, n, target;
+
+  n = FUNCTION_INSTRUCTION_COUNT(f);
+  c.code = dynamic_byte_array(256);
+  c.entries = malloc(sizeof(ufixnum_t) * (n + 1));
+  c.exits = malloc(sizeof(ufixnum_t) * (n + 1));
+  c.patches_capacity = 64;
+  c.patches_length = 0;
+  c.patches = malloc(sizeof(struct jit_patch) * c.patches_capacity);
+  NC(c.entries, "Failed to allocate JIT entries.");
+  NC(c.exits, "Failed to allocate JIT exits.");
+  NC(c.patches, "Failed to allocate JIT patches.");
+  for (i = 0; i <= n; ++i) c.exits[i] = -1;
+
+  /* ufixnum_t code(struct native_state *state, void *entry) -- five pushes keep the stack 16 byte aligned */
+  emit_push(&c, reg_rbx);
+  emit_push(&c, reg_r12);
+  emit_push(&c, reg_r13);
+  emit_push(&c, reg_r14);
+  emit_push(&c, reg_r15);
+  emit_move(&c, REG_STATE, reg_rdi);
+  emit_load(&c, REG_SP, REG_STATE, offsetof(struct native_state, sp));
+  emit_load(&c, REG_LOCALS, REG_STATE, offsetof(struct native_state, locals));
+  emit_load(&c, REG_CONSTANTS, REG_STATE, offsetof(struct native_state, constants));
+  emit(&c, 0xFF); /* jmp rsi */
+  emit(&c, 0xE6);
+
+  for (i = 0; i < n; ++i) {
+    c.entries[i] = emit_offset(&c);
+    emit_instruction(&c, i, decoded_instruction(f, i));
+  }
+  /* the end of the function's code -- run finishes the function */
+  c.entries[n] = emit_offset(&c);
+  emit_jump(&c, cc_always, n, 1);
+
+  /* each exit tells run which instruction to go on from */
+  for (i = 0; i <= n; ++i) {
+    if (c.exits[i] == (ufixnum_t)-1) continue;
+    c.exits[i] = emit_offset(&c);
+    emit(&c, 0xB8); /* mov eax, i */
+    emit_u32(&c, i);
+    emit_store(&c, REG_STATE, offsetof(struct native_state, sp), REG_SP);
+    emit_pop(&c, reg_r15);
+    emit_pop(&c, reg_r14);
+    emit_pop(&c, reg_r13);
+    emit_pop(&c, reg_r12);
+    emit_pop(&c, reg_rbx);
+    emit(&c, 0xC3); /* ret */
+  }
+
+  for (i = 0; i < c.patches_length; ++i) {
+    patch = &c.patches[i];
+    target = patch->exit ? c.exits[patch->instruction] : c.entries[patch->instruction];
+    if (!patch->exit && patch->instruction == n) target = c.exits[n]; /* jumping to the end */
+    target -= patch->at + 4;
+    DYNAMIC_BYTE_ARRAY_BYTES(c.code)[patch->at] = target & 0xFF;
+    DYNAMIC_BYTE_ARRAY_BYTES(c.code)[patch->at + 1] = (target >> 8) & 0xFF;
+    DYNAMIC_BYTE_ARRAY_BYTES(c.code)[patch->at + 2] = (target >> 16) & 0xFF;
+    DYNAMIC_BYTE_ARRAY_BYTES(c.code)[patch->at + 3] = (target >> 24) & 0xFF;
+  }
+
+  jit = malloc(sizeof(struct jit_code));
+  NC(jit, "Failed to allocate JIT code.");
+  jit->size = emit_offset(&c);
+  jit->code = mmap(NULL, jit->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (jit->code == MAP_FAILED) {
+    printf("Failed to allocate memory for JIT code.\n");
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  memcpy(jit->code, DYNAMIC_BYTE_ARRAY_BYTES(c.code), jit->size);
+  if (mprotect(jit->code, jit->size, PROT_READ | PROT_EXEC) != 0) {
+    printf("Failed to make JIT code executable.\n");
+    PRINT_STACK_TRACE_AND_QUIT();
+  }
+  jit->entries = c.entries;
+  free(c.exits);
+  free(c.patches);
+  return jit;
+}
+
+/* runs compiled code from instruction i, and returns the instruction it stopped at */
+ufixnum_t jit_run(struct jit_code *jit, struct native_state *state, ufixnum_t i) {
+  ufixnum_t (*code)(struct native_state *, void *);
+  void *start;
+  start = jit->code;
+  memcpy(&code, &start, sizeof(code)); /* ISO C has no cast from a data pointer to a function pointer */
+  return code(state, jit->code + jit->entries[i]);
+}
+
+void jit_free(struct jit_code *jit) {
+  munmap(jit->code, jit->size);
+  free(jit->entries);
+  free(jit);
+}
@@ -0,0 +1,20 @@
+#ifndef _JIT_H
+#define _JIT_H
+
+#include "bug.h"
+
+/* a function compiled to machine code */
+struct jit_code {
+  unsigned char *code; /* the machine code (executable memory from mmap) */
+  size_t size;
+  ufixnum_t *entries; /* where the code for each instruction starts (indexed by instruction) */
+};
+
+extern ufixnum_t jit_threshold;
+
+void jit_init();
+struct jit_code *jit_compile(struct object *f);
+ufixnum_t jit_run(struct jit_code *jit, struct native_state *state, ufixnum_t i);
+void jit_free(struct jit_code *jit);
+
+#endif
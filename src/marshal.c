@@ -209,6 +209,8 @@ struct object *marshal_fixnum(struct object *n, struct object *ba) {
 
 struct object *marshal_ufixnum(struct object *n, struct object *ba, char include_header) {
   OT2("marshal_ufixnum", 0, n, type_ufixnum, type_fixnum);
+  if (object_type_of(n) == type_fixnum)
+    return marshal_ufixnum_t(FIXNUM_VALUE(n), ba, include_header);
   return marshal_ufixnum_t(UFIXNUM_VALUE(n), ba, include_header);
 }
 
@@ -264,7 +266,7 @@ struct object *marshal_function(struct object *bc, struct object *ba, char inclu
   if (FUNCTION_NAME(bc) != NIL)
     marshal_symbol(FUNCTION_NAME(bc), ba, cache);
   marshal_ufixnum_t(FUNCTION_NARGS(bc), ba, 0);
-  marshal_ufixnum_t(FUNCTION_ACCEPTS_ALL(bc), ba, 0);
+  marshal_ufixnum_t(function_parameters(bc), ba, 0);
   return ba;
 }
 
@@ -617,7 +619,7 @@ struct object *unmarshal_vec2(struct object *s, char includes_header) {
 struct object *unmarshal_function(struct object *s, char includes_header, struct object *cache) {
   unsigned char t;
   struct object *constants, *code, *f;
-  ufixnum_t stack_size;
+  ufixnum_t stack_size, nargs;
   s = byte_stream_lift(s);
 
   if (includes_header) {
@@ -636,8 +638,8 @@ struct object *unmarshal_function(struct object *s, char includes_header, struct
   if (unmarshal_ufixnum_t(s) > 0) {
     FUNCTION_NAME(f) = unmarshal_symbol(s, cache);
   }
-  FUNCTION_NARGS(f) = unmarshal_ufixnum_t(s);
-  FUNCTION_ACCEPTS_ALL(f) = unmarshal_ufixnum_t(s);
+  nargs = unmarshal_ufixnum_t(s);
+  set_function_parameters(f, nargs, unmarshal_ufixnum_t(s)); /* (files from before there were optional parameters have 1 for all of them) */
   return f;
 }
 
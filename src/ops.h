@@ -81,5 +81,63 @@ enum ops {
   op_symbol_name,
   op_symbol_type,
   op_type_of,
-  op_write_file
+  op_write_file,
+  op_tail_call,
+  /* ops for functions declared (optimize (safety 0)) -- the compiler uses the fixnum ops when it knows
+     both operands are fixnums (see compiler-declare in lib/compiler/compile.bug). None of them check the
+     types of their operands. */
+  op_fixnum_add,
+  op_fixnum_sub,
+  op_fixnum_mul,
+  op_fixnum_lt,
+  op_fixnum_gt,
+  op_fixnum_lte,
+  op_fixnum_gte,
+  op_fixnum_eq,
+  op_unchecked_car,
+  op_unchecked_cdr,
+  /* ops for closures -- functions that use the locals of the functions they are made in (see "Closures" in
+     bug.c) */
+  op_make_closure,
+  op_load_closure,
+  op_store_box,
+  /* multiple values: a function returns more than one value with return-values, and whoever called it gets
+     them with multiple-values right after the call (see "Multiple values" in bug.c) */
+  op_return_values,
+  op_multiple_values,
+  /* special variables: a let of one binds its symbol's value cell with bind, and restores it with unbind
+     (see "Special variables" in bug.c) */
+  op_bind,
+  op_unbind,
+  /* quickened ops -- run rewrites the generic arithmetic and comparison ops to these in a function's
+     decoded instructions once it has seen what types of operands they get (see QUICKEN in bug.c).
+     They never appear in bytecode. */
+  op_add_fixnum_fixnum,
+  op_sub_fixnum_fixnum,
+  op_mul_fixnum_fixnum,
+  op_div_fixnum_fixnum,
+  op_gt_fixnum_fixnum,
+  op_lt_fixnum_fixnum,
+  op_gte_fixnum_fixnum,
+  op_lte_fixnum_fixnum,
+  op_add_flonum_flonum,
+  op_sub_flonum_flonum,
+  op_mul_flonum_flonum,
+  op_div_flonum_flonum,
+  op_gt_flonum_flonum,
+  op_lt_flonum_flonum,
+  op_gte_flonum_flonum,
+  op_lte_flonum_flonum,
+  /* superinstructions -- decode_function replaces the first op of some common pairs of ops with one op
+     that does the work of both (see fuse_superinstructions in bug.c). They never appear in bytecode. */
+  op_load_nil_drop,
+  op_drop_load_from_stack,
+  op_load_from_stack_load_from_stack,
+  op_load_from_stack_const,
+  op_load_from_stack_jump_forward_when_nil,
+  op_lt_jump_forward_when_nil,
+  op_fixnum_lt_jump_forward_when_nil,
+  /* runs a block of register instructions that does the work of the ops it replaced (see "Register form"
+     in bug.c). It never appears in bytecode. */
+  op_registers
 };
\ No newline at end of file
@@ -16,9 +16,9 @@ void string_reverse(struct object *o) {
 struct object *string_concat_external(struct object *s0, struct object *s1) {
   struct object *s2; 
 
-  if (OBJECT_TYPE(s0) != type_string)
+  if (object_type_of(s0) != type_string)
     s0 = to_string(s0);
-  if (OBJECT_TYPE(s1) != type_string)
+  if (object_type_of(s1) != type_string)
     s1 = to_string(s1);
 
   s2 = dynamic_byte_array_concat(s0, s1);
@@ -0,0 +1,29 @@
+/* A compiler-aot library that is out of date with bootstrap/compiler.bc, for stale.sh: it has the functions of
+ * the real one, but each says it was compiled from bytecode one byte longer than the function's, and aborts if
+ * it is run anyway. bug has to see that none of them match and interpret the whole compiler.
+ * (Built by the compiler-aot-stale target, with the build directory on the include path.) */
+#include <stdlib.h>
+
+#define aot_table aot_table_current
+#include "compiler-aot.c"
+#undef aot_table
+
+static ufixnum_t run_stale(struct native_state *state, ufixnum_t i) {
+  (void)state;
+  (void)i;
+  abort();
+  return 0;
+}
+
+AOT_EXPORT struct aot_function *aot_table(ufixnum_t *count) {
+  struct aot_function *current, *stale;
+  ufixnum_t k;
+  current = aot_table_current(count);
+  stale = malloc((*count + 1) * sizeof(struct aot_function));
+  for (k = 0; k < *count; ++k) {
+    stale[k].code_length = current[k].code_length + 1;
+    stale[k].code = current[k].code;
+    stale[k].run = run_stale;
+  }
+  return stale;
+}
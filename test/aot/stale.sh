@@ -0,0 +1,36 @@
+#!/bin/sh
+# Checks that bug interprets the bootstrap compiler when its compiler-aot library is out of date.
+#
+# usage: test/aot/stale.sh <build-dir>
+#
+# The build directory must be directly inside the repository and configured with -DBUG_AOT=ON.
+# Builds compiler-aot-stale (see compiler-aot-stale.c), runs lib/compiler/test.bug with it in place
+# of compiler-aot, and fails unless every test passes. A stale function that was run would abort.
+
+repo_dir=$(cd "$(dirname "$0")/../.." && pwd)
+build_dir=$1
+
+if [ ! -x "$build_dir/bug" ]; then
+  echo "usage: $0 <build-dir>"
+  exit 1
+fi
+
+cmake --build "$build_dir" --target compiler-aot-stale > /dev/null || exit 1
+library=$(ls "$build_dir"/compiler-aot-stale.* | head -n 1)
+
+# a directory next to the build directory to run in (bug loads ./compiler-aot and ../bootstrap)
+run_dir=$(mktemp -d "$repo_dir/_aot_stale.XXXXXX") || exit 1
+trap 'rm -rf "$run_dir"' EXIT
+cp "$build_dir/bug" "$run_dir/"
+cp "$library" "$run_dir/compiler-aot.${library##*.}"
+
+# The REPL doesn't exit at the end of its input, so stop reading once the last line is printed
+output=$(cd "$run_dir" && { cat "$repo_dir/lib/compiler/test.bug"; printf '\n(print "tests done\\n")\n'; } |
+         ./bug 2>&1 | sed '/tests done/q')
+echo "$output" | grep -a "ok \|FAIL"
+
+if echo "$output" | grep -a -q "FAIL" || ! echo "$output" | grep -a -q "tests done"; then
+  echo "FAIL aot-stale"
+  exit 1
+fi
+echo "ok aot-stale"